@@ -1,22 +1,110 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
 #include <fstream>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "delay_analysis.h"
 #include "packet.h"
+#include "packet_filter.h"
+#include "sharded_flow_map.h"
 #include "tcp_endpoint.h"
 #include "tcp_flow_map.h"
 #include "tcp_packet.h"
+#include "tgz_archive.h"
 #include "util.h"
 
 const std::vector<std::string> kDirections = { "a2b", "b2a" };
 const std::vector<uint16_t> kPercentiles = {10, 25, 50, 75, 90};
 const std::vector<uint32_t> kTimerRelativeSeqs = {
     1, 20*1024, 50*1024, 100*1024, 200*1024, 500*1024, 1000*1024};
-const uint32_t kEarlyTailPerformerMaxSeq = 102400;
+// Relative sequence numbers given with --tail_cutoffs (parsed once at startup)
+std::vector<uint32_t> tail_cutoffs;
+
+DEFINE_bool(headers_only, false,
+        "Drop the payload of all packets at ingest and only keep their headers "
+        "(the analysis never reads payload bytes). This bounds memory use by "
+        "the number of packets instead of the size of the trace");
+DEFINE_bool(streaming, false,
+        "Analyze and print each flow as soon as it is closed or idle (and "
+        "release its memory) instead of after reading the whole trace. Flows "
+        "are then printed in the order they are done, indexed by the order "
+        "they were first seen. Combine with --headers_only to bound memory "
+        "use by the number of concurrently active flows");
+DEFINE_int32(idle_timeout_s, 120,
+        "In streaming mode, flows without packets for this long (in trace "
+        "time) are considered done");
+DEFINE_int32(shards, 1,
+        "Number of worker threads that build and analyze the flows. Packets "
+        "are distributed by their 4-tuple, so each flow is handled by a single "
+        "thread. The output is the same as with a single thread");
+DEFINE_int32(reorder_window, 4096,
+        "Restore the timestamp order of packets captured out of order by "
+        "buffering up to this many packets (0 keeps the capture order). If "
+        "the window is too small, the rest of the capture is sorted fully");
+DEFINE_string(filter, "",
+        "Only analyze packets matching this capture filter expression (in "
+        "pcap-filter syntax, e.g. \"tcp port 3010\"). Other packets are "
+        "dropped before they are parsed");
+DEFINE_int32(threads, 1,
+        "Number of captures that are analyzed concurrently. Rows are still "
+        "printed in the order the captures were given");
+DEFINE_int32(top_k, 1,
+        "Break down the delays of the packets with the k worst ACK delays. "
+        "The columns of the packets after the worst one are appended to each "
+        "row (see -p)");
+DEFINE_string(tail_cutoffs, "",
+        "Comma-separated list of relative sequence numbers (e.g. 102400 for "
+        "the first 100 KB). For each, the delays of the worst packet up to "
+        "that sequence number are appended to each row (see -p)");
+DEFINE_string(per_packet_output, "",
+        "Also break down the delay of every data packet and write one row per "
+        "packet to this file (see -p for the columns)");
+
+// Adds the names of the delay breakdown columns (see PrintDelays)
+void AddDelayFields(const std::string& prefix,
+        std::vector<std::string>* fields) {
+    fields->push_back(prefix + "Tail latency (overall, in microseconds)");
+    fields->push_back(prefix + "Tail latency (from propagation)");
+    fields->push_back(prefix + "Tail latency (from loss)");
+    fields->push_back(prefix + "Tail latency (from loss trigger)");
+    fields->push_back(prefix + "Tail latency (from queueing)");
+    fields->push_back(prefix + "Tail latency (from other)");
+    fields->push_back(prefix + "Tail latency (from no-queue timeout)");
+    fields->push_back(prefix + "Trigger breakdown: from timeout");
+    fields->push_back(prefix + "Trigger breakdown: from late ACK arming");
+    fields->push_back(prefix + "Trigger breakdown: from late ACK triggering");
+    fields->push_back(prefix + "Trigger breakdown: from late trigger(s) for final trigger");
+}
+
+// Adds the names of the goodput columns (see PrintGoodputMetrics)
+void AddGoodputFields(const std::string& prefix,
+        std::vector<std::string>* fields) {
+    fields->push_back(prefix + "Goodput before worst packet (bps)");
+    fields->push_back(prefix + "Bytes acked before worst packet");
+    fields->push_back(prefix + "Bytes needed buffered (to compensate worst packet delay)");
+    fields->push_back(prefix + "Bytes unacked before worst packet");
+}
+
+// Adds the names of the tail latency columns (see PrintTailLatency)
+void AddTailLatencyFields(const std::string& prefix,
+        std::vector<std::string>* fields) {
+    AddDelayFields(prefix, fields);
+    fields->push_back(prefix + "Unacked bytes/RTT Pearson correlation coefficient");
+    fields->push_back(prefix + "c_0 value of linear fit (y = c_0 + c_1 * x)");
+    fields->push_back(prefix + "c_1 value of linear fit");
+    fields->push_back(prefix + "Sum-squared error of linear fit");
+    AddGoodputFields(prefix, fields);
+}
 
 void PrintOutputFormat() {
     std::vector<std::string> fields;
@@ -26,27 +114,7 @@ void PrintOutputFormat() {
     fields.push_back("# data packets");
     fields.push_back("# lost packets");
     fields.push_back("# missing trigger packets");
-    for (std::string prefix : {"All: "}) {
-        fields.push_back(prefix + "Tail latency (overall, in microseconds)");
-        fields.push_back(prefix + "Tail latency (from propagation)");
-        fields.push_back(prefix + "Tail latency (from loss)");
-        fields.push_back(prefix + "Tail latency (from loss trigger)");
-        fields.push_back(prefix + "Tail latency (from queueing)");
-        fields.push_back(prefix + "Tail latency (from other)");
-        fields.push_back(prefix + "Tail latency (from no-queue timeout)");
-        fields.push_back(prefix + "Trigger breakdown: from timeout");
-        fields.push_back(prefix + "Trigger breakdown: from late ACK arming");
-        fields.push_back(prefix + "Trigger breakdown: from late ACK triggering");
-        fields.push_back(prefix + "Trigger breakdown: from late trigger(s) for final trigger");
-        fields.push_back(prefix + "Unacked bytes/RTT Pearson correlation coefficient");
-        fields.push_back(prefix + "c_0 value of linear fit (y = c_0 + c_1 * x)");
-        fields.push_back(prefix + "c_1 value of linear fit");
-        fields.push_back(prefix + "Sum-squared error of linear fit");
-        fields.push_back(prefix + "Goodput before worst packet (bps)");
-        fields.push_back(prefix + "Bytes acked before worst packet");
-        fields.push_back(prefix + "Bytes needed buffered (to compensate worst packet delay)");
-        fields.push_back(prefix + "Bytes unacked before worst packet");
-    }
+    AddTailLatencyFields("All: ", &fields);
     for (auto seq : kTimerRelativeSeqs) {
         auto seq_str = std::to_string(seq);
         fields.push_back("Seq " + seq_str + ": RTO estimate");
@@ -57,6 +125,18 @@ void PrintOutputFormat() {
         fields.push_back("Seq " + seq_str + ": Queue-free TLP+delayed ACK estimate");
     }
 
+    // The worst packet's columns are the ones above, the others share its
+    // linear fit ("worst packet" in the goodput columns refers to each packet)
+    for (int32_t rank = 2; rank <= FLAGS_top_k; rank++) {
+        const std::string prefix = "Worst #" + std::to_string(rank) + ": ";
+        AddDelayFields(prefix, &fields);
+        AddGoodputFields(prefix, &fields);
+    }
+    for (uint32_t max_seq : tail_cutoffs) {
+        AddTailLatencyFields("Seq <= " + std::to_string(max_seq) + ": ",
+                &fields);
+    }
+
     // TODO Generates lots of output, so we omit this for now
     // fields.push_back("# Unacked bytes/RTT pairs");
     // fields.push_back("[Multiple columns] Raw pairs");
@@ -66,125 +146,463 @@ void PrintOutputFormat() {
         std::cout << std::setw(2) << column_index++ << " "
                   << field << std::endl;
     }
+
+    std::vector<std::string> packet_fields;
+    packet_fields.push_back("Input filename");
+    packet_fields.push_back("Flow index");
+    packet_fields.push_back("Direction");
+    packet_fields.push_back("Relative seq");
+    packet_fields.push_back("Latency (overall, in microseconds)");
+    packet_fields.push_back("Latency (from propagation)");
+    packet_fields.push_back("Latency (from loss)");
+    packet_fields.push_back("Latency (from loss trigger)");
+    packet_fields.push_back("Latency (from queueing)");
+    packet_fields.push_back("Latency (from other)");
+    packet_fields.push_back("Latency (from no-queue timeout)");
+    packet_fields.push_back("Trigger breakdown: from timeout");
+    packet_fields.push_back("Trigger breakdown: from late ACK arming");
+    packet_fields.push_back("Trigger breakdown: from late ACK triggering");
+    packet_fields.push_back("Trigger breakdown: from late trigger(s) for final trigger");
+
+    std::cout << std::endl << "Per-packet output (--per_packet_output):"
+              << std::endl;
+    column_index = 1;
+    for (const std::string field : packet_fields) {
+        std::cout << std::setw(2) << column_index++ << " "
+                  << field << std::endl;
+    }
+}
+
+// Prints the delay breakdown columns of a packet
+void PrintDelays(std::ostream& output, const Delays& delays) {
+    output << delays.overall_us_ << ","
+           << delays.propagation_us_ << ","
+           << delays.loss_us_ << ","
+           << delays.loss_trigger_us_ << ","
+           << delays.queueing_us_ << ","
+           << delays.other_us_ << ",";
+
+    const TriggerDelays& trigger_breakdown = delays.loss_trigger_breakdown_;
+    output << trigger_breakdown.no_queue_timeout_us_ << ","
+           << trigger_breakdown.timeout_us_ << ","
+           << trigger_breakdown.late_ack_arms_us_ << ","
+           << trigger_breakdown.late_ack_triggers_us_ << ","
+           << trigger_breakdown.late_trigger_for_trigger_us_ << ",";
+}
+
+// Prints the goodput columns of a packet
+void PrintGoodputMetrics(std::ostream& output, const Delays& delays) {
+    output << delays.goodput_before_worst_packet_bps_ << ","
+           << delays.bytes_acked_before_worst_packet_ << ","
+           << delays.bytes_needed_buffered_ << ","
+           << delays.bytes_unacked_ << ",";
+}
+
+// Prints the tail latency summary, trigger breakdown, correlation and best
+// linear fit parameters, and goodput metrics of the last analysis
+void PrintTailLatency(std::ostream& output, const Delays& tail_latency,
+        const DelayAnalysis& delay_analysis) {
+    PrintDelays(output, tail_latency);
+
+    auto correlation = delay_analysis.correlation();
+    auto fit = delay_analysis.fit();
+    output << correlation << ","
+           << fit.c_0 << ","
+           << fit.c_1 << ","
+           << fit.sum_sq << ",";
+
+    PrintGoodputMetrics(output, tail_latency);
+}
+
+// Prints the delay breakdown of every data packet of the given sender (one
+// CSV row per packet)
+void PrintPacketDelays(std::ostream& output, const std::string& input_filename,
+        uint32_t flow_index, const std::string& direction,
+        const TcpEndpoint& sender, DelayAnalysis* delay_analysis) {
+    for (const PacketDelays& packet_delays :
+            delay_analysis->AnalyzePacketDelays()) {
+        output << input_filename << ","
+               << flow_index << ","
+               << direction << ","
+               << packet_delays.first->tcp()->unwrapped_seq() -
+                  sender.GetUnwrappedSeq(0) << ",";
+        PrintDelays(output, packet_delays.second);
+        output << std::endl;
+    }
+}
+
+// Prints the analysis of both directions of the given flow (one CSV row per
+// direction with a valid sender). If a per-packet output is given, the
+// breakdown of each data packet is printed to it as well
+void PrintFlowAnalysis(std::ostream& output, std::ostream* packet_output,
+        const std::string& input_filename, uint32_t flow_index,
+        const TcpFlow& flow) {
+    for (auto direction : kDirections) {
+        const TcpEndpoint* sender = (direction == "a2b") ?
+            flow.endpoint_a() : flow.endpoint_b();
+        const TcpEndpoint* receiver = (direction == "a2b") ?
+            flow.endpoint_b() : flow.endpoint_a();
+        if (sender == nullptr || receiver == nullptr ||
+                sender->is_bogus()) {
+            VLOG(1) << "Endpoint has bogus data. Skipping.";
+            continue;
+        }
+        
+        // Output metadata
+        output << input_filename << ","
+               << flow_index << ","
+               << direction << ","
+               << sender->GetNumDataPackets() << ","
+               << sender->GetNumLosses() << ","
+               << sender->GetNumMissingTriggerPackets() << ",";
+
+        // Output analysis:
+        // a. for the tail performer among all packets (the next worst packets
+        // are found in the same pass, see --top_k)
+        // b. for the tail performers carrying a seqno up to each of the
+        // cutoffs (see --tail_cutoffs), at the end of the row
+        DelayAnalysis delay_analysis(*sender);
+        const std::vector<PacketDelays> tail_delays =
+            delay_analysis.AnalyzeTailLatencies(std::max(FLAGS_top_k, 1), 0);
+        Delays tail_latency = {0};
+        if (!tail_delays.empty()) {
+            tail_latency = tail_delays.front().second;
+        }
+        PrintTailLatency(output, tail_latency, delay_analysis);
+
+        // Timer estimates (make sure this is preceded by the right analysis
+        // to tag the worst packet and compute the proper queuing delays)
+        auto estimate_list = delay_analysis.GetTimerEstimates(kTimerRelativeSeqs);
+        for (auto estimates : estimate_list) {
+            output << estimates.rto_us_ << ","
+                   << estimates.tlp_us_ << ","
+                   << estimates.tlp_delayed_ack_us_ << ","
+                   << estimates.queue_free_rto_us_ << ","
+                   << estimates.queue_free_tlp_us_ << ","
+                   << estimates.queue_free_tlp_delayed_ack_us_ << ",";
+        }
+
+        // Breakdowns of the other worst packets (empty if there are fewer)
+        for (int32_t rank = 2; rank <= FLAGS_top_k; rank++) {
+            Delays delays = {0};
+            if (static_cast<size_t>(rank) <= tail_delays.size()) {
+                delays = tail_delays[rank - 1].second;
+            }
+            PrintDelays(output, delays);
+            PrintGoodputMetrics(output, delays);
+        }
+
+        // Tail performers up to each cutoff (looked up in an index of the
+        // worst packets instead of scanning again). This comes last since it
+        // replaces the analysis that the timer estimates rely on
+        for (uint32_t max_seq : tail_cutoffs) {
+            PrintTailLatency(output, delay_analysis.AnalyzeTailLatency(max_seq),
+                    delay_analysis);
+        }
+
+        // TODO Generates lots of output, so we omit this for now
+        // auto bytes_rtt_pairs = sender->GetUnackedBytesRttPairs();
+        // std::vector<double> rtts, unacked_bytes;
+        // vector_util::SplitPairs(bytes_rtt_pairs, &unacked_bytes, &rtts);
+        // output << bytes_rtt_pairs.size();
+        // if (bytes_rtt_pairs.empty()) {
+        //     output << std::endl;
+        //     continue;
+        // }
+
+        // Print binned unacked bytes/RTT pairs
+        // auto populated_bins = stats_util::PopulatedHistogramBins(
+        //         bytes_rtt_pairs, 1024, 1000);
+        // for (auto bin : populated_bins) {
+        //     output << "," << (int) bin.first
+        //               << "," << (int) bin.second;
+        // }
+        output << std::endl;
+
+        if (packet_output != nullptr) {
+            PrintPacketDelays(*packet_output, input_filename, flow_index,
+                    direction, *sender, &delay_analysis);
+        }
+    }
+}
+
+// Analyzes all flows of the given capture (a filename or a MappedPcap) and
+// prints them to the output(s), tagged with the given name.
+// Returns FALSE, if the capture could not be processed (completely)
+template<typename PcapSource>
+bool AnalyzeCapture(const std::string& input_filename, PcapSource pcap,
+        std::ostream& output, std::ostream* packet_output) {
+    TcpFlowMapFactory flow_map_factory(FLAGS_headers_only,
+            FLAGS_reorder_window, FLAGS_filter);
+    if (FLAGS_streaming) {
+        // Flows are printed (and released) as soon as they are done. Their
+        // index is the order in which they were first seen in the capture
+        auto print_flow = [&input_filename, &output, packet_output](
+                const TcpFlow& flow) {
+            PrintFlowAnalysis(output, packet_output, input_filename,
+                    flow.index(), flow);
+        };
+        return flow_map_factory.StreamFromPcap(std::move(pcap), print_flow,
+                FLAGS_idle_timeout_s * 1000000ULL);
+    }
+
+    if (FLAGS_shards > 1) {
+        auto flow_map = flow_map_factory.MakeShardedFromPcap(std::move(pcap),
+                FLAGS_shards);
+        if (flow_map == nullptr) {
+            return false;
+        }
+
+        // Flows are analyzed concurrently, but printed in order of their index
+        std::vector<std::string> flow_outputs(flow_map->num_flows());
+        std::vector<std::string> flow_packet_outputs(flow_map->num_flows());
+        flow_map->ProcessFlows([&input_filename, &flow_outputs,
+                    &flow_packet_outputs, packet_output](
+                    uint32_t flow_index, const TcpFlow& flow) {
+            std::ostringstream flow_output;
+            std::ostringstream flow_packet_output;
+            PrintFlowAnalysis(flow_output,
+                    packet_output != nullptr ? &flow_packet_output : nullptr,
+                    input_filename, flow_index, flow);
+            flow_outputs[flow_index] = flow_output.str();
+            flow_packet_outputs[flow_index] = flow_packet_output.str();
+        });
+        for (size_t i = 0; i < flow_outputs.size(); i++) {
+            output << flow_outputs[i];
+            if (packet_output != nullptr) {
+                *packet_output << flow_packet_outputs[i];
+            }
+        }
+        return true;
+    }
+
+    auto flow_map = flow_map_factory.MakeFromPcap(std::move(pcap));
+    if (flow_map == nullptr) {
+        return false;
+    }
+
+    uint32_t flow_index = 0;
+    for (const TcpFlow* flow : flow_map->GetFlows()) {
+        PrintFlowAnalysis(output, packet_output, input_filename, flow_index++,
+                *flow);
+    }
+    return true;
+}
+
+// Returns TRUE if the given file is a (gzip-compressed) tar archive
+bool IsArchive(const std::string& filename) {
+    for (const std::string suffix : {".tgz", ".tar.gz"}) {
+        if (filename.size() >= suffix.size() &&
+                filename.compare(filename.size() - suffix.size(),
+                    suffix.size(), suffix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns TRUE if the archive entry is an NDT trace of the server-to-client
+// direction (which may be gzip-compressed itself)
+bool IsServerTrace(const std::string& entry_name) {
+    return entry_name.find(".s2c_ndttrace") != std::string::npos;
+}
+
+// Analyzes the given capture or all NDT traces in the given archive (which are
+// read straight from the archive in memory) and prints their rows. Rows of
+// traces are tagged with their name in the archive. Captures, traces or
+// archives that could not be processed get an ERROR row.
+// Returns FALSE, if anything could not be processed
+bool AnalyzeFile(const std::string& input_filename, std::ostream& output,
+        std::ostream* packet_output) {
+    if (!IsArchive(input_filename)) {
+        if (!AnalyzeCapture(input_filename, input_filename.c_str(), output,
+                    packet_output)) {
+            output << input_filename << ",ERROR" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    auto archive = TgzArchive::Open(input_filename.c_str());
+    if (archive == nullptr) {
+        output << input_filename << ",ERROR" << std::endl;
+        return false;
+    }
+    bool is_complete = true;
+    std::string entry_name;
+    uint64_t entry_size;
+    while (archive->NextEntry(&entry_name, &entry_size)) {
+        // Other entries (e.g. client-to-server traces) are skipped without
+        // decompressing them
+        if (!IsServerTrace(entry_name)) {
+            continue;
+        }
+        auto mapped_pcap = archive->ReadPcapEntry(entry_size);
+        if (mapped_pcap == nullptr ||
+                !AnalyzeCapture(entry_name, std::move(mapped_pcap), output,
+                    packet_output)) {
+            output << entry_name << ",ERROR" << std::endl;
+            is_complete = false;
+        }
+    }
+    if (archive->is_corrupt()) {
+        output << input_filename << ",ERROR" << std::endl;
+        return false;
+    }
+    return is_complete;
+}
+
+// Analyzes the given captures (or archives) on a pool of worker threads. The
+// output of each file is printed once it and all files before it are done, so
+// rows come in the order of the files (also in the per-packet output, if any).
+// Returns FALSE, if any capture could not be processed
+bool AnalyzeFiles(const std::vector<std::string>& input_filenames,
+        size_t num_threads, std::ostream* packet_output) {
+    std::vector<std::string> outputs(input_filenames.size());
+    std::vector<std::string> packet_outputs(input_filenames.size());
+    std::vector<bool> is_done(input_filenames.size(), false);
+    bool is_complete = true;
+    std::mutex mutex;
+    std::condition_variable done_condition;
+
+    std::atomic<size_t> next_input(0);
+    auto analyze_files = [&]() {
+        for (size_t i = next_input++; i < input_filenames.size();
+                i = next_input++) {
+            std::ostringstream output;
+            std::ostringstream file_packet_output;
+            const bool is_valid = AnalyzeFile(input_filenames[i], output,
+                    packet_output != nullptr ? &file_packet_output : nullptr);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            outputs[i] = output.str();
+            packet_outputs[i] = file_packet_output.str();
+            is_done[i] = true;
+            is_complete &= is_valid;
+            done_condition.notify_one();
+        }
+    };
+    std::vector<std::thread> threads;
+    num_threads = std::min(num_threads, input_filenames.size());
+    for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+        threads.emplace_back(analyze_files);
+    }
+
+    for (size_t i = 0; i < input_filenames.size(); i++) {
+        std::string output;
+        std::string file_packet_output;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done_condition.wait(lock, [&is_done, i]() {
+                return is_done[i];
+            });
+            output.swap(outputs[i]);
+            file_packet_output.swap(packet_outputs[i]);
+        }
+        std::cout << output << std::flush;
+        if (packet_output != nullptr) {
+            *packet_output << file_packet_output << std::flush;
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return is_complete;
+}
+
+// Adds the relative sequence numbers in the given comma-separated list.
+// Returns FALSE, if the list contains anything but positive 32-bit numbers
+bool ParseSeqList(const std::string& list, std::vector<uint32_t>* seqs) {
+    std::istringstream items(list);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        char* end;
+        const unsigned long long seq = strtoull(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || !seq || seq > UINT32_MAX) {
+            return false;
+        }
+        seqs->push_back(seq);
+    }
+    return true;
+}
+
+// Adds the filenames listed in the given stream (one per line)
+void ReadInputFilenames(std::istream& list,
+        std::vector<std::string>* input_filenames) {
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty()) {
+            input_filenames->push_back(line);
+        }
+    }
 }
 
 int main(int argc, char* argv[]) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
 
-    if (argc != 2) {
+    if (!ParseSeqList(FLAGS_tail_cutoffs, &tail_cutoffs)) {
+        std::cerr << "Invalid list of tail cutoffs: " << FLAGS_tail_cutoffs
+                  << std::endl;
+        return 1;
+    }
+
+    if (argc < 2) {
         std::cerr << "Wrong number of parameters." << std::endl
                   << "Usage: " << argv[0]
-                  << " -p|<pcap filename>" << std::endl;
+                  << " [--headers_only] [--streaming [--idle_timeout_s=<seconds>]]"
+                  << " [--reorder_window=<packets>] [--filter=<expression>]"
+                  << " [--shards=<threads>] [--threads=<threads>]"
+                  << " [--top_k=<packets>] [--tail_cutoffs=<seq>,...]"
+                  << " [--per_packet_output=<filename>]"
+                  << " -p|<pcap/tgz filename|@list filename|->..." << std::endl;
         return 1;
     }
     const std::string print_option("-p");
-    if (print_option.compare(argv[1]) == 0) {
+    if (argc == 2 && print_option.compare(argv[1]) == 0) {
         PrintOutputFormat();
         return 0;
     }
-   
-    TcpFlowMapFactory flow_map_factory;
-    auto flow_map = flow_map_factory.MakeFromPcap(argv[1]);
-    if (flow_map == nullptr) {
+
+    // Reject an invalid filter once instead of failing each capture
+    if (!FLAGS_filter.empty() &&
+            PacketFilter::Compile(FLAGS_filter, DLT_EN10MB) == nullptr) {
         return 1;
     }
-    
-    const std::string input_filename = std::string(argv[1]);
-    uint16_t flow_index = 0;
-    for (auto const& mapped_flow : flow_map->map()) {
-        const TcpFlow& flow = *(mapped_flow.second.get());
-        for (auto direction : kDirections) {
-            const TcpEndpoint* sender = (direction == "a2b") ?
-                flow.endpoint_a() : flow.endpoint_b();
-            const TcpEndpoint* receiver = (direction == "a2b") ?
-                flow.endpoint_b() : flow.endpoint_a();
-            if (sender == nullptr || receiver == nullptr ||
-                    sender->is_bogus()) {
-                VLOG(1) << "Endpoint has bogus data. Skipping.";
-                continue;
-            }
-            
-            // Output metadata
-            std::cout << input_filename << ","
-                      << flow_index << ","
-                      << direction << ","
-                      << sender->GetNumDataPackets() << ","
-                      << sender->GetNumLosses() << ","
-                      << sender->GetNumMissingTriggerPackets() << ",";
-
-            // Output analysis:
-            // a. for the tail performer among all packets
-            // b. for the tail performer carrying a seqno <
-            // kEarlyTailPerformerMaxSeq
-            DelayAnalysis delay_analysis(*sender);
-            // for (auto max_seq :
-            //        std::initializer_list<uint32_t>{0, kEarlyTailPerformerMaxSeq}) {
-            for (auto max_seq : std::initializer_list<uint32_t>{0}) {
-                // Output tail latency summary
-                Delays tail_latency = delay_analysis.AnalyzeTailLatency(max_seq);
-                std::cout << tail_latency.overall_us_ << ","
-                          << tail_latency.propagation_us_ << ","
-                          << tail_latency.loss_us_ << ","
-                          << tail_latency.loss_trigger_us_ << ","
-                          << tail_latency.queueing_us_ << ","
-                          << tail_latency.other_us_ << ",";
-
-                // Output trigger breakdown
-                TriggerDelays trigger_breakdown = tail_latency.loss_trigger_breakdown_;
-                std::cout << trigger_breakdown.no_queue_timeout_us_ << ","
-                          << trigger_breakdown.timeout_us_ << ","
-                          << trigger_breakdown.late_ack_arms_us_ << ","
-                          << trigger_breakdown.late_ack_triggers_us_ << ","
-                          << trigger_breakdown.late_trigger_for_trigger_us_ << ",";
-
-                // Output correlation and best linear fit parameters
-                auto correlation = delay_analysis.correlation();
-                auto fit = delay_analysis.fit();
-                std::cout << correlation << ","
-                          << fit.c_0 << ","
-                          << fit.c_1 << ","
-                          << fit.sum_sq << ",";
-
-                // Goodput metrics
-                std::cout << tail_latency.goodput_before_worst_packet_bps_ << ","
-                          << tail_latency.bytes_acked_before_worst_packet_ << ","
-                          << tail_latency.bytes_needed_buffered_ << ","
-                          << tail_latency.bytes_unacked_ << ",";
-            }
 
-            // Timer estimates (make sure this is preceded by the right analysis
-            // to tag the worst packet and compute the proper queuing delays)
-            auto estimate_list = delay_analysis.GetTimerEstimates(kTimerRelativeSeqs);
-            for (auto estimates : estimate_list) {
-                std::cout << estimates.rto_us_ << ","
-                          << estimates.tlp_us_ << ","
-                          << estimates.tlp_delayed_ack_us_ << ","
-                          << estimates.queue_free_rto_us_ << ","
-                          << estimates.queue_free_tlp_us_ << ","
-                          << estimates.queue_free_tlp_delayed_ack_us_ << ",";
+    // Captures are given directly, listed in a file (@<filename>) or listed on
+    // stdin (-)
+    std::vector<std::string> input_filenames;
+    for (int i = 1; i < argc; i++) {
+        const std::string argument(argv[i]);
+        if (argument == "-") {
+            ReadInputFilenames(std::cin, &input_filenames);
+        } else if (argument[0] == '@') {
+            std::ifstream list(argument.substr(1));
+            if (!list) {
+                std::cerr << "Cannot open list of captures: "
+                          << argument.substr(1) << std::endl;
+                return 1;
             }
+            ReadInputFilenames(list, &input_filenames);
+        } else {
+            input_filenames.push_back(argument);
+        }
+    }
+
+    // Per-packet rows go to a separate file to keep the main output compact
+    std::ofstream packet_output;
+    if (!FLAGS_per_packet_output.empty()) {
+        packet_output.open(FLAGS_per_packet_output);
+        if (!packet_output) {
+            std::cerr << "Cannot open per-packet output: "
+                      << FLAGS_per_packet_output << std::endl;
+            return 1;
+        }
+    }
 
-            // TODO Generates lots of output, so we omit this for now
-            // auto bytes_rtt_pairs = sender->GetUnackedBytesRttPairs();
-            // std::vector<double> rtts, unacked_bytes;
-            // vector_util::SplitPairs(bytes_rtt_pairs, &unacked_bytes, &rtts);
-            // std::cout << bytes_rtt_pairs.size();
-            // if (bytes_rtt_pairs.empty()) {
-            //     std::cout << std::endl;
-            //     continue;
-            // }
-
-            // Print binned unacked bytes/RTT pairs
-            // auto populated_bins = stats_util::PopulatedHistogramBins(
-            //         bytes_rtt_pairs, 1024, 1000);
-            // for (auto bin : populated_bins) {
-            //     std::cout << "," << (int) bin.first
-            //               << "," << (int) bin.second;
-            // }
-            std::cout << std::endl;
-        }
-        flow_index++;
-    }
-
-    return 0;
+    return AnalyzeFiles(input_filenames, FLAGS_threads,
+            packet_output.is_open() ? &packet_output : nullptr) ? 0 : 1;
 }
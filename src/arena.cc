@@ -0,0 +1,46 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+const size_t Arena::kMinBlockSize = 4096;
+const size_t Arena::kMaxBlockSize = 1 << 20;  // 1 MB
+
+Arena::~Arena() {
+    for (auto it = cleanups_.rbegin(); it != cleanups_.rend(); ++it) {
+        it->destroy_(it->object_);
+    }
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(cursor_);
+    uintptr_t aligned = (address + alignment - 1) & ~(alignment - 1);
+    if (cursor_ == nullptr ||
+            aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+        AddBlock(size + alignment);
+        address = reinterpret_cast<uintptr_t>(cursor_);
+        aligned = (address + alignment - 1) & ~(alignment - 1);
+    }
+
+    cursor_ = reinterpret_cast<char*>(aligned + size);
+    bytes_allocated_ += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+u_char* Arena::Copy(const u_char* data, size_t len) {
+    u_char* copy = static_cast<u_char*>(Allocate(len, 1));
+    memcpy(copy, data, len);
+    return copy;
+}
+
+void Arena::AddBlock(size_t min_size) {
+    const size_t block_size = std::max(next_block_size_, min_size);
+    blocks_.push_back(std::make_unique<char[]>(block_size));
+    cursor_ = blocks_.back().get();
+    end_ = cursor_ + block_size;
+
+    if (next_block_size_ < kMaxBlockSize) {
+        next_block_size_ <<= 1;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <memory>
+#include <new>
+#include <pcap.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that share the same lifetime (e.g. all packets of
+// a flow). Objects are never freed individually; all memory is released at
+// once when the arena is destroyed. Destructors of objects that need them are
+// run at that time as well (in reverse order of allocation).
+class Arena {
+    public:
+        // Size of the first block. Each further block doubles in size up to
+        // the maximum so that small flows don't waste much memory
+        static const size_t kMinBlockSize;
+        static const size_t kMaxBlockSize;
+
+        Arena() = default;
+        ~Arena();
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        inline size_t bytes_allocated() const {
+            return bytes_allocated_;
+        }
+
+        // Returns uninitialized memory of the given size and alignment
+        void* Allocate(size_t size, size_t alignment);
+
+        // Copies the given bytes into the arena
+        u_char* Copy(const u_char* data, size_t len);
+
+        // Constructs a new object in the arena
+        template<typename T, typename... Args>
+        T* Make(Args&&... args);
+
+    private:
+        typedef struct {
+            void* object_;
+            void (*destroy_)(void*);
+        } Cleanup;
+
+        template<typename T>
+        static void Destroy(void* object) {
+            static_cast<T*>(object)->~T();
+        }
+
+        // Starts a new block that fits at least the given number of bytes
+        void AddBlock(size_t min_size);
+
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        size_t next_block_size_ = kMinBlockSize;
+
+        // Free space in the current block
+        char* cursor_ = nullptr;
+        char* end_ = nullptr;
+
+        // Objects that need their destructor run when the arena is destroyed
+        std::vector<Cleanup> cleanups_;
+
+        size_t bytes_allocated_ = 0;
+};
+
+template<typename T, typename... Args>
+T* Arena::Make(Args&&... args) {
+    T* object = new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+        cleanups_.push_back({object, &Arena::Destroy<T>});
+    }
+    return object;
+}
+
+#endif  /* ARENA_H_ */
@@ -0,0 +1,21 @@
+#include "buffered_packet.h"
+
+#include <cstring>
+
+BufferedPacket::BufferedPacket(const Packet& packet, uint32_t copy_len)
+        : packet_(copy_len == 0 ? Packet(packet) :
+                Packet(packet, CopyBytes(packet.packet(), copy_len), copy_len)),
+          is_copy_(copy_len > 0) {
+    // Copies don't keep the index
+    packet_.set_index(packet.index());
+}
+
+u_char* BufferedPacket::CopyBytes(const u_char* bytes, uint32_t len) {
+    u_char* copy = inline_bytes_;
+    if (len > kInlineBytes) {
+        heap_bytes_.reset(new u_char[len]);
+        copy = heap_bytes_.get();
+    }
+    memcpy(copy, bytes, len);
+    return copy;
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFERED_PACKET_H_
+#define BUFFERED_PACKET_H_
+
+#include <memory>
+#include <pcap.h>
+
+#include "packet.h"
+
+// Packet that is held back before it is added to a flow map (e.g. queued for
+// another thread or reordered). Bytes that may not outlive the packet's
+// source (e.g. bytes handed to a libpcap callback or released pages of a
+// mapped capture) are copied into this object
+class BufferedPacket {
+    public:
+        // Copies the first copy_len bytes of the given packet (none if
+        // copy_len is 0, then this wraps the original bytes)
+        BufferedPacket(const Packet& packet, uint32_t copy_len);
+
+        BufferedPacket(const BufferedPacket&) = delete;
+        BufferedPacket& operator=(const BufferedPacket&) = delete;
+
+        inline const Packet& packet() const {
+            return packet_;
+        }
+        inline Packet* packet() {
+            return &packet_;
+        }
+        inline bool is_copy() const {
+            return is_copy_;
+        }
+
+    private:
+        // Enough for the link, IP and TCP headers including options
+        static const uint32_t kInlineBytes = 128;
+
+        // Copies the given bytes into this object and returns the copy
+        u_char* CopyBytes(const u_char* bytes, uint32_t len);
+
+        u_char inline_bytes_[kInlineBytes];
+        std::unique_ptr<u_char[]> heap_bytes_;
+
+        // Wraps inline_bytes_ or heap_bytes_ if the bytes were copied
+        Packet packet_;
+
+        const bool is_copy_;
+};
+
+#endif  /* BUFFERED_PACKET_H_ */
@@ -1,10 +1,13 @@
 #include "delay_analysis.h"
 
+#include <algorithm>
 #include <glog/logging.h>
+#include <queue>
 #include <utility>
 #include <vector>
 
 #include "tcp_packet.h"
+#include "unacked_bytes_rtt_window.h"
 
 // Configuration parameters (see delay_analysis.h for a detailed description of
 // each parameter)
@@ -12,9 +15,11 @@ typedef DelayAnalysis DA;
 
 constexpr float DA::kMinUnackedBytesRttCorrelation = 0.5;
 constexpr uint32_t kBytesPerMicrosecondInBitsPerSecond = 8E6;
+constexpr uint8_t kNumRttSamplesAroundPacket = 60;
 
 DelayAnalysis::DelayAnalysis(const TcpEndpoint& endpoint)
-        : endpoint_(endpoint) {
+        : endpoint_(endpoint),
+          worst_packet_index_(endpoint.packets()) {
     Clear();
 }
 
@@ -23,11 +28,12 @@ void DelayAnalysis::Clear() {
     first_packet_ = nullptr;
     worst_packet_ = nullptr;
     correlation_ = -1;
+    trigger_delays_.clear();
 }
 
 
 std::vector<TimerEstimates> DelayAnalysis::GetTimerEstimates(
-        std::vector<uint32_t> relative_seqs) {
+        const std::vector<uint32_t>& relative_seqs) {
     std::vector<TimerEstimates> estimate_list;
 
     if (relative_seqs.empty() || worst_packet_ == nullptr) {
@@ -41,7 +47,7 @@ std::vector<TimerEstimates> DelayAnalysis::GetTimerEstimates(
 
     // Compute queue-free timers along the way
     TcpTimer queue_free_timer;
-    auto rtt_samples = endpoint_.timer().samples();
+    const auto& rtt_samples = endpoint_.timer().samples();
     if (rtt_samples.empty()) {
         return estimate_list;
     }
@@ -73,7 +79,8 @@ std::vector<TimerEstimates> DelayAnalysis::GetTimerEstimates(
             }
         }
 
-        if (!tcp_util::Before(tcp->relative_seq(), relative_seqs[index])) {
+        if (tcp->unwrapped_seq() >=
+                endpoint_.GetUnwrappedSeq(relative_seqs[index])) {
             TimerEstimates estimate;
             estimate.seq_ = relative_seqs[index];
             estimate.rto_us_ = tcp->rto_estimate_us();
@@ -105,19 +112,86 @@ Delays DelayAnalysis::AnalyzeTailLatency() {
 }
 
 Delays DelayAnalysis::AnalyzeTailLatency(uint32_t max_relative_seq) {
-    const std::vector<Packet*> packets = endpoint_.packets();
+    AnalyzeTailLatencies(1, max_relative_seq);
+    return tail_latency_;
+}
+
+std::vector<PacketDelays> DelayAnalysis::AnalyzeTailLatencies(
+        size_t num_packets, uint32_t max_relative_seq) {
+    std::vector<PacketDelays> tail_delays;
 
     Clear();
-    if (packets.empty()) {
+    if (endpoint_.packets().empty()) {
         VLOG(1) << "Endpoint has no packets";
-        return tail_latency_;
+        return tail_delays;
     }
 
-    // Find the packet with the worst ACK delay (latency)
-    for (const Packet* packet : packets) {
+    // Find the packets with the worst ACK delays (latency)
+    const std::vector<const Packet*> worst_packets =
+        FindWorstPackets(num_packets, max_relative_seq);
+    if (worst_packets.empty()) {
+        VLOG(1) << "Endpoint has no packets with relative seq below "
+                << max_relative_seq;
+        return tail_delays;
+    }
+    worst_packet_ = worst_packets.front();
+    VLOG(3) << "Worst packet - Seq: " << worst_packet_->tcp()->seq();
+    tail_latency_.bytes_unacked_ = endpoint_.GetUnackedBytes(*worst_packet_);
+
+    ComputeGoodputMetrics(*worst_packet_, &tail_latency_);
+
+    // Queueing delay is only attributed if the number of unacked bytes and
+    // the RTT are correlated around the worst packet (the other packets share
+    // that fit)
+    const bool use_fit = worst_packet_->tcp()->ack_delay_us() &&
+        CalculateRttLinearFit(*worst_packet_) &&
+        correlation_ > kMinUnackedBytesRttCorrelation;
+    BreakDownDelay(*worst_packet_, use_fit, &tail_latency_);
+    tail_delays.emplace_back(worst_packet_, tail_latency_);
+
+    for (auto packet_it = worst_packets.cbegin() + 1;
+            packet_it != worst_packets.cend(); ++packet_it) {
+        const Packet* packet = *packet_it;
+        Delays delays = {0};
+        delays.bytes_unacked_ = endpoint_.GetUnackedBytes(*packet);
+        ComputeGoodputMetrics(*packet, &delays);
+        BreakDownDelay(*packet, use_fit, &delays);
+        tail_delays.emplace_back(packet, delays);
+    }
+    return tail_delays;
+}
+
+std::vector<const Packet*> DelayAnalysis::FindWorstPackets(
+        size_t num_packets, uint32_t max_relative_seq) {
+    const uint64_t max_seq = endpoint_.GetUnwrappedSeq(max_relative_seq);
+    if (num_packets == 1) {
+        const size_t prefix_length = max_relative_seq ?
+            worst_packet_index_.GetPrefixLength(max_seq) :
+            worst_packet_index_.size();
+        first_packet_ = worst_packet_index_.GetFirstDataPacket(prefix_length);
+        const Packet* worst_packet =
+            worst_packet_index_.GetWorstPacket(prefix_length);
+        if (worst_packet == nullptr) {
+            return std::vector<const Packet*>();
+        }
+        return std::vector<const Packet*>(1, worst_packet);
+    }
+
+    // The top of the heap is the best of the worst packets found so far. Among
+    // equally delayed packets, earlier ones are considered worse
+    auto is_worse = [](const Packet* first, const Packet* second) {
+        const uint32_t first_delay_us = first->tcp()->ack_delay_us();
+        const uint32_t second_delay_us = second->tcp()->ack_delay_us();
+        return first_delay_us > second_delay_us ||
+            (first_delay_us == second_delay_us &&
+             first->position() < second->position());
+    };
+    std::priority_queue<const Packet*, std::vector<const Packet*>,
+        decltype(is_worse)> worst_packets(is_worse);
+
+    for (const Packet* packet : endpoint_.packets()) {
         const auto* tcp = packet->tcp();
-        if (max_relative_seq &&
-                tcp_util::After(tcp->relative_seq(), max_relative_seq)) {
+        if (max_relative_seq && tcp->unwrapped_seq() > max_seq) {
             break;
         }
         if (!tcp->data_len()) {
@@ -126,116 +200,142 @@ Delays DelayAnalysis::AnalyzeTailLatency(uint32_t max_relative_seq) {
         if (!first_packet_) {
             first_packet_ = packet;
         }
-        if (!worst_packet_ ||
-                tcp->ack_delay_us() > worst_packet_->tcp()->ack_delay_us()) {
-            worst_packet_ = packet;
+        if (worst_packets.size() < num_packets) {
+            worst_packets.push(packet);
+        } else if (num_packets && is_worse(packet, worst_packets.top())) {
+            worst_packets.pop();
+            worst_packets.push(packet);
         }
     }
+
+    // Order the packets from worst to best
+    std::vector<const Packet*> sorted_packets(worst_packets.size());
+    for (auto packet_it = sorted_packets.rbegin();
+            packet_it != sorted_packets.rend(); ++packet_it) {
+        *packet_it = worst_packets.top();
+        worst_packets.pop();
+    }
+    return sorted_packets;
+}
+
+std::vector<PacketDelays> DelayAnalysis::AnalyzePacketDelays() {
+    std::vector<PacketDelays> packet_delays;
+    AnalyzeTailLatency();
     if (!worst_packet_) {
-        VLOG(1) << "Endpoint has no packets with relative seq below "
-                << max_relative_seq;
-        return tail_latency_;
+        return packet_delays;
     }
-    VLOG(3) << "Worst packet - Seq: " << worst_packet_->tcp()->seq();
-    tail_latency_.bytes_unacked_ = worst_packet_->tcp()->unacked_bytes();
 
-    ComputeGoodputMetrics();
+    // All packets share the linear fit chosen for the worst packet, and thus
+    // the queue-free timeouts and trigger delays computed along the way
+    const bool use_fit = correlation_ > kMinUnackedBytesRttCorrelation;
+    for (const Packet* packet : endpoint_.packets()) {
+        if (!packet->tcp()->data_len()) {
+            continue;
+        }
+        Delays delays = {0};
+        BreakDownDelay(*packet, use_fit, &delays);
+        packet_delays.emplace_back(packet, delays);
+    }
+    return packet_delays;
+}
 
-    tail_latency_.overall_us_ = worst_packet_->tcp()->ack_delay_us();
-    VLOG(1) << "Worst, overall (ms): " << tail_latency_.overall_us_ / 1000;
-    if (!tail_latency_.overall_us_) {
-        return tail_latency_;
+void DelayAnalysis::BreakDownDelay(const Packet& packet, bool use_fit,
+        Delays* delays) {
+    delays->overall_us_ = packet.tcp()->ack_delay_us();
+    VLOG(1) << "Overall (ms): " << delays->overall_us_ / 1000;
+    if (!delays->overall_us_) {
+        return;
     }
-    tail_latency_.propagation_us_ = endpoint_.min_rtt_us();
-    VLOG(1) << "Worst, propagation (ms): " << tail_latency_.propagation_us_ / 1000;
+    delays->propagation_us_ = endpoint_.min_rtt_us();
+    VLOG(1) << "Propagation (ms): " << delays->propagation_us_ / 1000;
 
-    // Tie the delay to a retransmission delay if the packet is lost
-    if (worst_packet_->IsLost()) {
-        tail_latency_.loss_us_ = worst_packet_->tcp()->final_rtx_delay_us();
-        tail_latency_.time_to_first_rtx_us_ =
-            worst_packet_->rtx()->timestamp_us() - worst_packet_->timestamp_us();
+    // Tie the delay to a retransmission delay if the packet is lost (only
+    // first transmissions track the delay until the final retransmission)
+    const Packet* last_tx = &packet;
+    while (last_tx->IsLost()) {
+        last_tx = last_tx->rtx();
     }
-    VLOG(1) << "Worst, overall loss (ms): " << tail_latency_.loss_us_ / 1000;
+    if (packet.IsLost()) {
+        delays->loss_us_ = packet.previous_tx() == nullptr ?
+            packet.tcp()->final_rtx_delay_us() :
+            last_tx->timestamp_us() - packet.timestamp_us();
+        delays->time_to_first_rtx_us_ =
+            packet.rtx()->timestamp_us() - packet.timestamp_us();
+    }
+    VLOG(1) << "Overall loss (ms): " << delays->loss_us_ / 1000;
 
     // Compute the fraction of the delay that can be attributed to queueing
     // (either directly or related to the delay of the trigger packet)
-    if (CalculateRttLinearFit(*worst_packet_) &&
-            correlation_ > kMinUnackedBytesRttCorrelation) {
+    if (use_fit) {
         // Queueing delay is determined by the packet that reached the receiver
         VLOG(2) << "Connection has high rtt/flight correlation";
-        const Packet* last_tx = worst_packet_;
-        while (last_tx->IsLost()) {
-            last_tx = last_tx->rtx();
-        }
-        tail_latency_.queueing_us_ = GetQueueingDelay(*last_tx);
-        tail_latency_.loss_trigger_breakdown_ = GetTriggerDelay(*worst_packet_);
-        tail_latency_.loss_trigger_us_ = tail_latency_.loss_trigger_breakdown_.total();
+        delays->queueing_us_ =
+            GetQueueingDelay(*last_tx, fit_, delays->propagation_us_);
+        delays->loss_trigger_breakdown_ = GetTriggerDelay(packet);
+        delays->loss_trigger_us_ = delays->loss_trigger_breakdown_.total();
     }
-    VLOG(1) << "Worst, trigger (ms): " << tail_latency_.loss_trigger_us_ / 1000;
-    VLOG(1) << "Worst, queueing (ms): " << tail_latency_.queueing_us_ / 1000;
-
+    VLOG(1) << "Trigger (ms): " << delays->loss_trigger_us_ / 1000;
+    VLOG(1) << "Queueing (ms): " << delays->queueing_us_ / 1000;
     // TODO check other causes
 
     // Enforce constraints (delay combinations cannot exceed overall delay)
     const uint32_t non_prop_loss_us =
-        tail_latency_.overall_us_ - tail_latency_.loss_us_ -
-        tail_latency_.propagation_us_;
-    if (tail_latency_.queueing_us_ > non_prop_loss_us) {
-        tail_latency_.queueing_us_ = non_prop_loss_us;
+        delays->overall_us_ - delays->loss_us_ - delays->propagation_us_;
+    if (delays->queueing_us_ > non_prop_loss_us) {
+        delays->queueing_us_ = non_prop_loss_us;
     }
 
     // Assign only non-trigger delay to the pure loss counter
     uint32_t base_loss_us =
-        tail_latency_.loss_trigger_breakdown_.no_queue_timeout_us_;
-    if (tail_latency_.loss_trigger_breakdown_.late_ack_arms_us_ ||
-        tail_latency_.loss_trigger_breakdown_.late_ack_triggers_us_) {
-        base_loss_us += tail_latency_.propagation_us_;
+        delays->loss_trigger_breakdown_.no_queue_timeout_us_;
+    if (delays->loss_trigger_breakdown_.late_ack_arms_us_ ||
+        delays->loss_trigger_breakdown_.late_ack_triggers_us_) {
+        base_loss_us += delays->propagation_us_;
     }
 
-    if (tail_latency_.loss_us_ < tail_latency_.loss_trigger_us_) {
-        tail_latency_.loss_us_ = 0;
+    if (delays->loss_us_ < delays->loss_trigger_us_) {
+        delays->loss_us_ = 0;
     } else {
-        tail_latency_.loss_us_ -= tail_latency_.loss_trigger_us_;
+        delays->loss_us_ -= delays->loss_trigger_us_;
     }
 
-    if (tail_latency_.loss_us_ < base_loss_us) {
-        uint32_t diff = base_loss_us - tail_latency_.loss_us_;
-        tail_latency_.loss_us_ += diff;
-        tail_latency_.loss_trigger_us_ -= diff;
+    if (delays->loss_us_ < base_loss_us) {
+        uint32_t diff = base_loss_us - delays->loss_us_;
+        delays->loss_us_ += diff;
+        delays->loss_trigger_us_ -= diff;
     }
 
-    VLOG(1) << "Worst, remaining loss (ms): " << tail_latency_.loss_us_ / 1000;
+    VLOG(1) << "Remaining loss (ms): " << delays->loss_us_ / 1000;
 
     // Store delay that has not been accounted for
-    tail_latency_.SetOtherDelay();
-    VLOG(1) << "Worst, other (ms): " << tail_latency_.other_us_ / 1000;
-
-    return tail_latency_;
+    delays->SetOtherDelay();
+    VLOG(1) << "Other (ms): " << delays->other_us_ / 1000;
 }
 
-void DelayAnalysis::ComputeGoodputMetrics() {
-    auto acked_bytes = worst_packet_->tcp()->acked_bytes();
+void DelayAnalysis::ComputeGoodputMetrics(const Packet& packet,
+        Delays* delays) const {
+    auto acked_bytes = packet.tcp()->acked_bytes();
     auto elapsed_time_us =
-        worst_packet_->timestamp_us() - first_packet_->timestamp_us();
+        packet.timestamp_us() - first_packet_->timestamp_us();
     if (!elapsed_time_us) {
-        VLOG(3) << "No time elapsed up to worst packet";
+        VLOG(3) << "No time elapsed up to packet";
         return;
     }
-    tail_latency_.bytes_acked_before_worst_packet_ = acked_bytes;
-    tail_latency_.goodput_before_worst_packet_bps_ =
+    delays->bytes_acked_before_worst_packet_ = acked_bytes;
+    delays->goodput_before_worst_packet_bps_ =
         acked_bytes * kBytesPerMicrosecondInBitsPerSecond / elapsed_time_us;
-    VLOG(3) << "Bytes acked before worst packet: "
-            << tail_latency_.bytes_acked_before_worst_packet_
+    VLOG(3) << "Bytes acked before packet: "
+            << delays->bytes_acked_before_worst_packet_
             << ", elapsed (us): "
             << elapsed_time_us;
 
-    // To continue consuming the achieved goodput rate once we reach the worst
+    // To continue consuming the achieved goodput rate once we reach the
     // packet, we need to have data buffered, but can consume additional
     // in-order acked data as well. To get the amount of data needed buffered we
     // start with a zero balance and keep the track of the largest balance seen
     // along the way.
-    const auto* start_ack = worst_packet_->tcp()->last_ack();
-    const auto* end_ack = worst_packet_->tcp()->ack_packet();
+    const auto* start_ack = packet.tcp()->last_ack();
+    const auto* end_ack = packet.tcp()->ack_packet();
     if (start_ack == nullptr || end_ack == nullptr) {
         VLOG(3) << "Cannot compute buffer size due to missing ACKs";
         return;
@@ -244,14 +344,14 @@ void DelayAnalysis::ComputeGoodputMetrics() {
     int32_t buffer_needed = 0;
     int32_t max_buffer_needed = 0;
     auto current_ack_no = start_ack->tcp()->ack();
-    auto current_timestamp = worst_packet_->timestamp_us();
+    auto current_timestamp = packet.timestamp_us();
     const auto* current_ack = start_ack->next_packet();
     while (current_ack != end_ack && current_ack != nullptr) {
         auto elapsed_time_us = current_ack->timestamp_us() - current_timestamp;
         current_timestamp = current_ack->timestamp_us();
 
         buffer_needed += elapsed_time_us * 
-            tail_latency_.goodput_before_worst_packet_bps_ /
+            delays->goodput_before_worst_packet_bps_ /
             kBytesPerMicrosecondInBitsPerSecond;
         if (buffer_needed > max_buffer_needed) {
             max_buffer_needed = buffer_needed;
@@ -263,7 +363,7 @@ void DelayAnalysis::ComputeGoodputMetrics() {
         current_ack = current_ack->next_packet();
     }
 
-    tail_latency_.bytes_needed_buffered_ = max_buffer_needed;
+    delays->bytes_needed_buffered_ = max_buffer_needed;
 }
 
 bool DelayAnalysis::CalculateRttLinearFit(const Packet& packet) {
@@ -273,9 +373,9 @@ bool DelayAnalysis::CalculateRttLinearFit(const Packet& packet) {
 
     // Try fitting based on multiple sample sets and use the one with the
     // highest correlation factor
-    std::vector<std::pair<bool, bool>> option_combos =
+    const std::pair<bool, bool> option_combos[] =
             { {false, false}, {true, false}, {true, true} };
-    for (auto option_combo : option_combos) {
+    for (const auto& option_combo : option_combos) {
         VLOG(2) << "Trying to find linear fit...";
         if (GetRttLinearFit(
                     &current_fit, &current_correlation, packet,
@@ -283,6 +383,7 @@ bool DelayAnalysis::CalculateRttLinearFit(const Packet& packet) {
                 current_correlation > correlation_) {
             fit_ = current_fit;
             correlation_ = current_correlation;
+            trigger_delays_.clear();
             found_fit = true;
             VLOG(2) << "Current correlation: " << correlation_;
         }
@@ -297,47 +398,100 @@ bool DelayAnalysis::GetRttLinearFit(
         const Packet& packet,
         bool use_packets_around_only,
         bool use_older_packets_only) {
-    auto bytes_rtt_pairs =
-        use_packets_around_only ?
-            endpoint_.GetUnackedBytesRttPairsAroundPacket(
-                    packet, 60, use_older_packets_only) :
-            endpoint_.GetUnackedBytesRttPairs();
-    if (bytes_rtt_pairs.empty()) {
+    // Collect the sums over all <# unacked bytes, RTT> samples in one pass
+    stats_util::LinearFitAccumulator samples;
+    if (use_packets_around_only) {
+        endpoint_.AddUnackedBytesRttSamplesAroundPacket(
+                packet, kNumRttSamplesAroundPacket, use_older_packets_only,
+                &samples);
+    } else {
+        endpoint_.AddUnackedBytesRttSamples(&samples);
+    }
+    if (samples.num_samples() == 0) {
         VLOG(2) << "No byte/RTT pairs for fitting";
         return false;
     }
-    
-    std::vector<double> rtts, unacked_bytes;
-    vector_util::SplitPairs(bytes_rtt_pairs, &unacked_bytes, &rtts);
 
     // Check if the correlation between the number of unacked bytes and the RTT
     // is high enough (i.e. pending byte counts impact RTTs)
-    *correlation = stats_util::PearsonCorrelation(unacked_bytes, rtts);
+    *correlation = samples.Correlation();
 
     // Use regression to find the best linear fit with a constant term
-    *fit = stats_util::LinearFit(unacked_bytes, rtts);
+    *fit = samples.Fit();
    
     // The linear fit is only useful if it has a positive slope (i.e. with
     // growing number of unacked bytes the RTT grows too)
     return (fit->c_1 > 0);
 }
 
+std::vector<uint32_t> DelayAnalysis::GetQueueingDelays() const {
+    const std::vector<Packet*>& packets = endpoint_.packets();
+    std::vector<uint32_t> queueing_delays(packets.size(), 0);
+
+    // The fit over all samples is the same for every packet, the windows
+    // around the packets slide along while walking the packets in order
+    stats_util::LinearFitAccumulator all_samples;
+    endpoint_.AddUnackedBytesRttSamples(&all_samples);
+    UnackedBytesRttWindow samples_around(
+            endpoint_, kNumRttSamplesAroundPacket, false);
+    UnackedBytesRttWindow older_samples(
+            endpoint_, kNumRttSamplesAroundPacket, true);
+    const double prop_delay_us = endpoint_.min_rtt_us();
+
+    for (const Packet* packet : packets) {
+        const stats_util::LinearFitAccumulator* sample_sets[] = {
+            &all_samples,
+            &samples_around.MoveTo(*packet),
+            &older_samples.MoveTo(*packet)
+        };
+        stats_util::LinearFitParameters fit;
+        double correlation = -1;
+        for (const auto* samples : sample_sets) {
+            if (samples->num_samples() == 0) {
+                continue;
+            }
+            const double current_correlation = samples->Correlation();
+            const stats_util::LinearFitParameters current_fit = samples->Fit();
+            if (current_fit.c_1 > 0 && current_correlation > correlation) {
+                fit = current_fit;
+                correlation = current_correlation;
+            }
+        }
+        if (correlation <= kMinUnackedBytesRttCorrelation) {
+            continue;
+        }
+
+        const Packet* last_tx = packet;
+        while (last_tx->IsLost()) {
+            last_tx = last_tx->rtx();
+        }
+        queueing_delays[packet->position()] =
+            GetQueueingDelay(*last_tx, fit, prop_delay_us);
+    }
+    return queueing_delays;
+}
+
 uint32_t DelayAnalysis::GetQueueingDelay(const Packet& packet) const {
+    return GetQueueingDelay(packet, fit_, tail_latency_.propagation_us_);
+}
+
+uint32_t DelayAnalysis::GetQueueingDelay(const Packet& packet,
+        const stats_util::LinearFitParameters& fit,
+        double prop_delay_us) const {
     // Compute the estimated RTT based on the given number of unacked bytes
     // when the given packet was transmitted
-    if (packet.tcp()->unacked_bytes() <= packet.tcp()->data_len()) {
+    const uint32_t unacked_bytes = endpoint_.GetUnackedBytes(packet);
+    if (unacked_bytes <= packet.tcp()->data_len()) {
         return 0;
     }
-    const auto bytes_before_tx =
-        packet.tcp()->unacked_bytes() - packet.tcp()->data_len();
+    const auto bytes_before_tx = unacked_bytes - packet.tcp()->data_len();
     const double estimated_rtt_us =
-        stats_util::LinearFitValueForX(fit_, bytes_before_tx);
+        stats_util::LinearFitValueForX(fit, bytes_before_tx);
     
     // Get the fraction of the RTT attributed to queueing.
     // We subtract the maximum chosen from the estimated y-intersect
     // (estimated RTT when no data is unacked) and the minimum RTT observed
-    const double prop_delay_us = tail_latency_.propagation_us_;
-    const double min_delay_us = std::max(fit_.c_0, prop_delay_us);
+    const double min_delay_us = std::max(fit.c_0, prop_delay_us);
 
     if (min_delay_us < estimated_rtt_us) {
         return estimated_rtt_us - min_delay_us;
@@ -347,6 +501,22 @@ uint32_t DelayAnalysis::GetQueueingDelay(const Packet& packet) const {
 }
 
 TriggerDelays DelayAnalysis::GetTriggerDelay(const Packet& packet) {
+    if (!packet.IsLost()) {
+        TriggerDelays delays = {0};
+        return delays;
+    }
+
+    // Trigger chains (e.g. multiple rounds of slow-start retransmissions) are
+    // shared by many packets, so each packet's delays are computed only once
+    auto trigger_delays_it = trigger_delays_.find(packet.position());
+    if (trigger_delays_it == trigger_delays_.end()) {
+        trigger_delays_it = trigger_delays_.emplace(
+                packet.position(), ComputeTriggerDelay(packet)).first;
+    }
+    return trigger_delays_it->second;
+}
+
+TriggerDelays DelayAnalysis::ComputeTriggerDelay(const Packet& packet) {
     TriggerDelays delays = {0};
     // Get the transmission that reached the receiver and then work backwards
     // towards the first transmission (via trigger packets or RTOs)
@@ -363,8 +533,9 @@ TriggerDelays DelayAnalysis::GetTriggerDelay(const Packet& packet) {
     if (no_queue_timeouts_.empty()) {
         ComputeQueueFreeTimeouts();
     }
+    // Stop at the given transmission (earlier ones do not delay it)
     const Packet* current_tx = last_tx;
-    while (current_tx->previous_tx() != nullptr) {
+    while (current_tx != &packet && current_tx->previous_tx() != nullptr) {
         // If the packet has a trigger packet associated with it, the trigger delay
         // equals the queueing delay of the trigger packet (e.g. for fast
         // retransmissions) and the trigger delay of the trigger packet (e.g.
@@ -457,7 +628,7 @@ uint32_t DelayAnalysis::GetArmingTimerDelay(const Packet& packet) const {
 
 void DelayAnalysis::ComputeQueueFreeTimeouts() {
     TcpTimer timer;
-    std::vector<RttSample> rtt_samples = endpoint_.timer().samples();
+    const std::vector<RttSample>& rtt_samples = endpoint_.timer().samples();
 
     // Add every RTT sample to a new timer with the queueing
     // delay subtracted
@@ -483,6 +654,16 @@ void DelayAnalysis::ComputeQueueFreeTimeouts() {
             no_queue_timeouts_.push_back(current_timeouts);
         }
     }
+
+    // ACK indices are mostly, but not strictly, increasing (e.g. for ACKs
+    // matched to SACK lookalikes later on), so lookups search the minimum
+    // indices of all suffixes instead
+    no_queue_timeout_min_indices_.resize(no_queue_timeouts_.size());
+    uint32_t min_index = UINT32_MAX;
+    for (size_t i = no_queue_timeouts_.size(); i-- > 0; ) {
+        min_index = std::min(min_index, std::get<0>(no_queue_timeouts_[i]));
+        no_queue_timeout_min_indices_[i] = min_index;
+    }
 }
 
 void DelayAnalysis::GetQueueFreeTimeouts(const Packet& packet,
@@ -501,19 +682,20 @@ void DelayAnalysis::GetQueueFreeTimeouts(const Packet& packet,
     }
 
     // Find the matching timeout estimate in the list of recomputed
-    // (queue-free) timeouts, i.e. the entry with the highest index
-    // below the index of the armer packet
-    for (auto it = no_queue_timeouts_.rbegin();
-            it != no_queue_timeouts_.rend(); ++it) {
-       IndexTimeouts timeouts = *it;
-       if (std::get<0>(timeouts) < armer->index()) {
-           // Found the matching timeout estimates
-           *rto = std::get<1>(timeouts);
-           *tlp = std::get<2>(timeouts);
-           *delayed_tlp = std::get<3>(timeouts);
-           return;
-       }
+    // (queue-free) timeouts, i.e. the last entry with an index below the
+    // index of the armer packet. That is the last entry whose suffix of
+    // timeouts contains a smaller index
+    auto min_index_it = std::lower_bound(
+            no_queue_timeout_min_indices_.begin(),
+            no_queue_timeout_min_indices_.end(), armer->index());
+    if (min_index_it == no_queue_timeout_min_indices_.begin()) {
+        return;
     }
+    const IndexTimeouts& timeouts = no_queue_timeouts_[
+        min_index_it - no_queue_timeout_min_indices_.begin() - 1];
+    *rto = std::get<1>(timeouts);
+    *tlp = std::get<2>(timeouts);
+    *delayed_tlp = std::get<3>(timeouts);
 }
 
 uint32_t DelayAnalysis::GetQueueFreeRTO(const Packet& packet) {
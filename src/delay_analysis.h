@@ -1,10 +1,14 @@
 #ifndef DELAY_ANALYSIS_H_
 #define DELAY_ANALYSIS_H_
 
+#include <map>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "tcp_endpoint.h"
 #include "util.h"
+#include "worst_packet_index.h"
 
 typedef std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> IndexTimeouts;
 
@@ -101,6 +105,9 @@ typedef struct {
     }
 } Delays;
 
+// Delay breakdown of a single data packet
+typedef std::pair<const Packet*, Delays> PacketDelays;
+
 class DelayAnalysis {
     public:
         // Minimum correlation coefficient required to attribute some delay to
@@ -114,12 +121,34 @@ class DelayAnalysis {
         // for each number the first packet with a number equal/larger will be
         // selected and its corresponding timer values returned
         std::vector<TimerEstimates> GetTimerEstimates(
-                std::vector<uint32_t> relative_seqs);
+                const std::vector<uint32_t>& relative_seqs);
 
         Delays AnalyzeTailLatency();
 
         Delays AnalyzeTailLatency(uint32_t max_relative_seq);
 
+        // Breaks down the delays of the given number of data packets with the
+        // worst ACK delays (worst first, found in a single pass). The worst
+        // packet is analyzed like in AnalyzeTailLatency and the others share
+        // its linear fit. Goodput metrics refer to each packet instead of the
+        // worst one
+        std::vector<PacketDelays> AnalyzeTailLatencies(size_t num_packets,
+                uint32_t max_relative_seq);
+
+        // Breaks down the delay of every data packet (in transmission order)
+        // like the tail latency analysis does for the worst packet. All
+        // packets use the linear fit chosen for the worst packet, so the
+        // queue-free timeouts and trigger delays are computed only once.
+        // Goodput metrics are left empty
+        std::vector<PacketDelays> AnalyzePacketDelays();
+
+        // Returns the queueing delay estimated for each packet of the
+        // endpoint (indexed by position). As for the worst packet, every
+        // estimate uses the most correlated of the fits over all samples and
+        // around the packet, and applies to the transmission that reached the
+        // receiver. Estimates are zero without a sufficiently correlated fit
+        std::vector<uint32_t> GetQueueingDelays() const;
+
         inline stats_util::LinearFitParameters fit() const {
             return fit_;
         }
@@ -130,7 +159,19 @@ class DelayAnalysis {
     private:
         void Clear();
 
-        void ComputeGoodputMetrics();
+        // Returns the given number of data packets with the worst ACK delays
+        // (worst first), considering only packets up to the given relative
+        // sequence number (if any). Also finds the first data packet. The
+        // worst packet alone is looked up in the index instead of scanning
+        std::vector<const Packet*> FindWorstPackets(size_t num_packets,
+                uint32_t max_relative_seq);
+
+        void ComputeGoodputMetrics(const Packet& packet, Delays* delays) const;
+
+        // Fills in the delay breakdown (overall, propagation, loss, trigger,
+        // queueing and other) of the given packet. Queueing and trigger delays
+        // are only attributed if use_fit is TRUE
+        void BreakDownDelay(const Packet& packet, bool use_fit, Delays* delays);
 
         // Generates a linear fit based on the <# unacked bytes, RTT> samples in
         // this connection. Returns TRUE, if a linear fit was generated and
@@ -145,16 +186,24 @@ class DelayAnalysis {
                 bool use_older_packets_only);
 
         // Extrapolates the queueing delay likely observed by the given packet
-        // using the given linear fit for # unacked bytes vs. RTT
+        // using the given linear fit for # unacked bytes vs. RTT (defaults to
+        // the fit and propagation delay of the tail latency analysis)
         uint32_t GetQueueingDelay(const Packet& packet) const;
 
+        uint32_t GetQueueingDelay(const Packet& packet,
+                const stats_util::LinearFitParameters& fit,
+                double prop_delay_us) const;
+
         // Extrapolates the trigger delays which equal the impact of queueing of
         // earlier packets on the transmission time of the current packet (e.g.
         // for a single fast retransmission the trigger delay equals the queueing
         // delay of the data packet that caused a SACK which then triggered the
-        // fast retransmission.
+        // fast retransmission. Results are memoized for the current fit
         TriggerDelays GetTriggerDelay(const Packet& packet);
 
+        // Computes the trigger delays (see above) without memoization
+        TriggerDelays ComputeTriggerDelay(const Packet& packet);
+
         // If the given packet is an RTO retransmission or a TLP, this computes
         // the impact of queueing delay on arming the timer (arming can be
         // delayed if it is caused by an ACK with a corresponding trigger
@@ -177,6 +226,7 @@ class DelayAnalysis {
         uint32_t GetQueueFreeDelayedTLP(const Packet& packet);
         
         const TcpEndpoint& endpoint_;
+        const WorstPacketIndex worst_packet_index_;
         const Packet* first_packet_;
         const Packet* worst_packet_;
 
@@ -189,6 +239,12 @@ class DelayAnalysis {
         // the index is the index of the first packet after which these
         // timeouts would be used
         std::vector<IndexTimeouts> no_queue_timeouts_;
+
+        // Minimum index of all timeouts from the given one on
+        std::vector<uint32_t> no_queue_timeout_min_indices_;
+
+        // Trigger delays of lost packets (by position) for the current fit
+        std::map<uint32_t, TriggerDelays> trigger_delays_;
 };
 
 #endif  /* DELAY_ANALYSIS_H_ */
@@ -1,35 +1,66 @@
 #ifndef ETHERNET_PACKET_H_
 #define ETHERNET_PACKET_H_
 
-#include <memory>
+#include <iostream>
 #include <net/ethernet.h>
 #include <netinet/ip.h>
+#include <pcap.h>
+#include <type_traits>
 
 #include "ip_packet.h"
 
-// PCAP processing is done by the TCP Flow map which initially determines
-// the datalink type of the packets captured in the tcpdump. The type
-// determines if and how the Ethernet header is parsed
-extern int pcap_datalink_type_;
+// Tag for the datalink type of a capture (which determines if and how the link
+// header is parsed). Packets are parsed by a decoder specialized for the type,
+// so the type is only checked once per capture instead of once per packet
+template<int kDatalinkType>
+using LinkType = std::integral_constant<int, kDatalinkType>;
+
+// Decoder of a link header, specialized for each supported datalink type
+template<int kDatalinkType>
+struct LinkHeader;
+
+// Calls the function with the LinkType tag of the given datalink type and
+// returns its result. Returns FALSE if the type is not supported
+template<typename Function>
+bool DispatchLinkType(int datalink_type, const Function& function);
 
 class EthernetPacket {
     public:
-        EthernetPacket(u_char* packet, const uint32_t caplen);
+        EthernetPacket();
+
+        // Parses the given bytes, which start with a link header of the given
+        // type
+        template<int kDatalinkType>
+        EthernetPacket(u_char* packet, const uint32_t caplen,
+                LinkType<kDatalinkType> link_type);
 
-        inline const u_char* packet() const {
-            return packet_;
+        // Parses the given bytes, which carry a copy of the first caplen bytes
+        // of the given (parsed) packet. The link header is not parsed again
+        EthernetPacket(const EthernetPacket& packet, u_char* packet_copy,
+                const uint32_t caplen);
+
+        inline const IpPacket* ip() const {
+            return has_ip_ ? &ip_ : nullptr;
         }
-        inline IpPacket* ip() const {
-            return ip_.get();
+        inline IpPacket* ip() {
+            return has_ip_ ? &ip_ : nullptr;
         }
 
         void Cut(const uint32_t offset, const uint32_t data_len);
 
     private:
-        const u_char* packet_;
-        struct ether_header* header_;
+        // Parses the IP packet following the link header
+        void ParseIp(u_char* packet, const uint32_t caplen);
+
+        // The IP layer is embedded so that a parsed packet is a single object
+        IpPacket ip_;
+        bool has_ip_;
 
-        std::unique_ptr<IpPacket> ip_;
+        // Length of the link header
+        uint16_t header_len_;
 };
 
+// Include definitions for templated functions
+#include "ethernet_packet.tcc"
+
 #endif  /* ETHERNET_PACKET_H_ */
@@ -0,0 +1,63 @@
+#include <arpa/inet.h>
+
+// We only allow Ethernet and Linux-cooked headers right now
+
+template<>
+struct LinkHeader<DLT_EN10MB> {
+    static const uint32_t kLength = sizeof(struct ether_header);
+
+    static inline uint16_t GetProtocol(const u_char* packet) {
+        return ntohs(((const struct ether_header*) packet)->ether_type);
+    }
+};
+
+template<>
+struct LinkHeader<DLT_LINUX_SLL> {
+    // Linux-cooked header definition (as described in libpcap's sll.h)
+    typedef struct pcap_sll_header {
+        static const uint16_t LINUX_SLL_HOST      = 0;
+        static const uint16_t LINUX_SLL_BROADCAST = 1;
+        static const uint16_t LINUX_SLL_MULTICAST = 2;
+        static const uint16_t LINUX_SLL_OTHERHOST = 3;
+        static const uint16_t LINUX_SLL_OUTGOING  = 4;
+
+        uint16_t  pkttype;    // packet type
+        uint16_t  hatype;     // link-layer address type
+        uint16_t  halen;      // link-layer address length
+        uint8_t   addr[8];    // link-layer address
+        uint16_t  protocol;   // protocol
+    } pcap_sll_header;
+
+    static const uint32_t kLength = sizeof(pcap_sll_header);
+
+    static inline uint16_t GetProtocol(const u_char* packet) {
+        return ntohs(((const pcap_sll_header*) packet)->protocol);
+    }
+};
+
+template<typename Function>
+bool DispatchLinkType(int datalink_type, const Function& function) {
+    switch (datalink_type) {
+        case DLT_EN10MB:  /* Ethernet */
+            return function(LinkType<DLT_EN10MB>());
+        case DLT_LINUX_SLL:  /* Linux-cooked header */
+            return function(LinkType<DLT_LINUX_SLL>());
+        default:
+            std::cerr << "Unsupported datalink type: "
+                      << datalink_type << std::endl;
+            return false;
+    }
+}
+
+template<int kDatalinkType>
+EthernetPacket::EthernetPacket(u_char* packet, const uint32_t caplen,
+        LinkType<kDatalinkType> link_type)
+        : has_ip_(false),
+          header_len_(LinkHeader<kDatalinkType>::kLength) {
+    if (caplen < header_len_) {
+        return;
+    }
+    if (LinkHeader<kDatalinkType>::GetProtocol(packet) == ETHERTYPE_IP) {
+        ParseIp(packet + header_len_, caplen - header_len_);
+    }
+}
@@ -0,0 +1,34 @@
+#include "fenwick_tree.h"
+
+void FenwickTree::Append() {
+    // The new node covers the pending difference of the new value and the
+    // differences of the preceding values within its range
+    const size_t index = tree_.size();
+    const size_t first_covered = index - (index & -index);
+    tree_.push_back(next_difference_ + Sum(index - 1) - Sum(first_covered));
+    next_difference_ = 0;
+}
+
+void FenwickTree::AddFrom(size_t first, int64_t delta) {
+    const size_t num_values = size();
+    if (first >= num_values) {
+        return;
+    }
+    for (size_t index = first + 1; index <= num_values;
+            index += index & -index) {
+        tree_[index] += delta;
+    }
+    next_difference_ -= delta;
+}
+
+int64_t FenwickTree::Get(size_t position) const {
+    return Sum(position + 1);
+}
+
+int64_t FenwickTree::Sum(size_t num_differences) const {
+    int64_t sum = 0;
+    for (size_t index = num_differences; index > 0; index -= index & -index) {
+        sum += tree_[index];
+    }
+    return sum;
+}
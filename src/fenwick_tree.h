@@ -0,0 +1,41 @@
+#ifndef FENWICK_TREE_H_
+#define FENWICK_TREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Growing sequence of values (starting at zero) that supports adding a delta
+// to all values from a given position onwards in O(log n). Internally, this is
+// a Fenwick tree over the differences between neighboring values, so reading a
+// value sums up O(log n) differences
+class FenwickTree {
+    public:
+        inline size_t size() const {
+            return tree_.size() - 1;
+        }
+
+        // Appends a new value of zero
+        void Append();
+
+        // Adds the delta to all current values starting at the given position
+        // (values appended later are not affected)
+        void AddFrom(size_t first, int64_t delta);
+
+        // Returns the value at the given position
+        int64_t Get(size_t position) const;
+
+    private:
+        // Returns the sum of the first num_differences differences
+        int64_t Sum(size_t num_differences) const;
+
+        // Differences stored 1-based, i.e. the node at index i covers the
+        // differences (i - (i & -i), i]
+        std::vector<int64_t> tree_ = std::vector<int64_t>(1, 0);
+
+        // Difference of the next value to be appended (cancels the deltas
+        // that were added to all current values)
+        int64_t next_difference_ = 0;
+};
+
+#endif  /* FENWICK_TREE_H_ */
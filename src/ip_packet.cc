@@ -1,24 +1,35 @@
 #include "ip_packet.h"
 
+IpPacket::IpPacket()
+        : src_addr_(0),
+          dst_addr_(0),
+          header_len_(0),
+          data_len_(0),
+          has_tcp_(false) {}
+
 IpPacket::IpPacket(u_char* packet, const uint32_t caplen)
-        : packet_(packet),
-          header_(nullptr),
-          tcp_(nullptr) {
+        : IpPacket() {
     size_t header_len = sizeof(struct ip);
     if (caplen < header_len) {
         return;
     }
 
-    header_ = (struct ip*) packet;
-    if (header_->ip_p == IPPROTO_TCP) {
+    const struct ip* header = (struct ip*) packet;
+    src_addr_ = header->ip_src.s_addr;
+    dst_addr_ = header->ip_dst.s_addr;
+    header_len_ = header->ip_hl << 2;
+    data_len_ = ntohs(header->ip_len) - header_len_;
+
+    if (header->ip_p == IPPROTO_TCP) {
         u_char* tcp_packet = packet + header_len;
         int32_t tcp_caplen = caplen - header_len;
         if (tcp_caplen > 0) {
-            tcp_ = std::make_unique<TcpPacket>(tcp_packet, data_len(), tcp_caplen);
+            tcp_ = TcpPacket(tcp_packet, data_len(), tcp_caplen);
+            has_tcp_ = true;
         }
     }
 }
 
 void IpPacket::Cut(const uint32_t offset, const uint32_t data_len) {
-    tcp_->Cut(offset, data_len);
+    tcp_.Cut(offset, data_len);
 }
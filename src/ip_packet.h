@@ -4,40 +4,45 @@
 #include "tcp_packet.h"
 
 #include <arpa/inet.h>
-#include <memory>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 
 class IpPacket {
     public:
+        IpPacket();
         IpPacket(u_char* packet, const uint32_t caplen);
 
-        inline const u_char* packet() const {
-            return packet_;
-        }
         inline const uint32_t src_addr() const {
-            return header_->ip_src.s_addr;
+            return src_addr_;
         }
         inline const uint32_t dst_addr() const {
-            return header_->ip_dst.s_addr;
+            return dst_addr_;
+        }
+        inline const TcpPacket* tcp() const {
+            return has_tcp_ ? &tcp_ : nullptr;
         }
-        inline TcpPacket* tcp() const {
-            return tcp_.get();
+        inline TcpPacket* tcp() {
+            return has_tcp_ ? &tcp_ : nullptr;
         }
         inline const uint32_t header_len() const {
-            return header_->ip_hl << 2;
+            return header_len_;
         }
         inline const uint32_t data_len() const {
-            return ntohs(header_->ip_len) - header_len();
+            return data_len_;
         }
 
         void Cut(const uint32_t offset, const uint32_t data_len);
 
     private:
-        const u_char* packet_;
-        struct ip* header_;
-
-        std::unique_ptr<TcpPacket> tcp_;
+        // Header fields (decoded once while parsing). Addresses are kept in
+        // network byte order
+        uint32_t src_addr_;
+        uint32_t dst_addr_;
+        uint32_t header_len_;
+        uint32_t data_len_;
+
+        TcpPacket tcp_;
+        bool has_tcp_;
 };
 
 #endif  /* IP_PACKET_H_ */
@@ -20,29 +20,14 @@ TEMP_DIR=`mktemp -d /tmp/tmp.XXXXXX`
 
 gsutil cp $GS_FILE $TEMP_DIR
 
-tar xzf $TEMP_DIR/*.tgz --strip=3 -C $TEMP_DIR
-rm -f $TEMP_DIR/*.c2s_ndttrace $TEMP_DIR/*.tgz
-
-# Check if there are any files to process.
-if ls $TEMP_DIR/*ndttrace >/dev/null 2>&1; then
-  cd $TEMP_DIR
-  for TRACE in `ls -1 *ndttrace`; do
-    if file $TRACE | grep 'gzip compressed data' > /dev/null; then
-      mv $TRACE $TRACE.gz
-      gunzip $TRACE.gz
-    fi
-    ulimit -Sv 100000000
-    echo "Trace: $TEMP_DIR/$TRACE"
-    mv $TRACE $TRACE.bkp
-    reordercap $TRACE.bkp $TRACE || continue
-    ($PROCESS_PCAP $TRACE || echo $TRACE,ERROR) | sed -e "s#^#$GS_FILE,#" >> result.csv
-  done
-  cd -
-
-  cp $TEMP_DIR/result.csv $CSV_FILE
-else
+# The server-to-client traces are read straight from the archive (whether they
+# are gzip-compressed or not) and reordered by timestamp in memory. Packets
+# only keep their headers, so memory use scales with the number of packets
+# rather than the size of the traces. Traces that fail get an ERROR row
+ulimit -Sv 8000000
+($PROCESS_PCAP --headers_only --threads=`nproc` $TEMP_DIR/*.tgz || true) | sed -e "s#^#$GS_FILE,#" > $CSV_FILE
+if [ ! -s $CSV_FILE ]; then
   echo "$GS_FILE has no trace data."
-  touch $CSV_FILE
 fi
 
 rm -rf $TEMP_DIR
@@ -0,0 +1,141 @@
+#include "mapped_pcap.h"
+
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File magic numbers of classic PCAP files (as described in libpcap's
+// savefile.c)
+constexpr uint32_t kPcapMagic = 0xa1b2c3d4;
+constexpr uint32_t kPcapNanosecondMagic = 0xa1b23c4d;
+
+constexpr size_t kFileHeaderLen = 24;
+constexpr size_t kRecordHeaderLen = 16;
+
+// Minimum number of consumed bytes released at once
+constexpr size_t kReleaseChunkLen = 16 << 20;  // 16 MB
+
+std::unique_ptr<MappedPcap> MappedPcap::Open(const char* filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 ||
+            static_cast<size_t>(file_stat.st_size) < kFileHeaderLen) {
+        close(fd);
+        return nullptr;
+    }
+
+    // The mapping stays valid after closing the file descriptor
+    const size_t size = file_stat.st_size;
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "mmap() failed for " << filename << std::endl;
+        return nullptr;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    std::unique_ptr<MappedPcap> mapped_pcap(
+            new MappedPcap(static_cast<u_char*>(data), size));
+    if (!mapped_pcap->ParseFileHeader()) {
+        return nullptr;
+    }
+    return mapped_pcap;
+}
+
+std::unique_ptr<MappedPcap> MappedPcap::Load(size_t size,
+        const std::function<bool(u_char* data)>& read) {
+    if (size < kFileHeaderLen) {
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "mmap() failed for " << size << " bytes" << std::endl;
+        return nullptr;
+    }
+
+    std::unique_ptr<MappedPcap> mapped_pcap(
+            new MappedPcap(static_cast<u_char*>(data), size));
+    if (!read(mapped_pcap->data_) || !mapped_pcap->ParseFileHeader()) {
+        return nullptr;
+    }
+    return mapped_pcap;
+}
+
+MappedPcap::MappedPcap(u_char* data, size_t size)
+        : data_(data),
+          size_(size) {}
+
+MappedPcap::~MappedPcap() {
+    munmap(data_, size_);
+}
+
+bool MappedPcap::ParseFileHeader() {
+    const uint32_t magic = *reinterpret_cast<const uint32_t*>(data_);
+    if (magic == kPcapMagic || magic == kPcapNanosecondMagic) {
+        is_swapped_ = false;
+    } else if (__builtin_bswap32(magic) == kPcapMagic ||
+            __builtin_bswap32(magic) == kPcapNanosecondMagic) {
+        is_swapped_ = true;
+    } else {
+        return false;
+    }
+    is_nanosecond_ = (ReadUint32(data_) == kPcapNanosecondMagic);
+
+    // The upper bits of the link type field can carry additional information
+    // (e.g. FCS length) which we don't need
+    datalink_type_ = ReadUint32(data_ + 20) & 0x03FFFFFF;
+    offset_ = kFileHeaderLen;
+
+    return true;
+}
+
+bool MappedPcap::Next(struct pcap_pkthdr* pcap_header, u_char** packet) {
+    if (offset_ == size_) {
+        return false;
+    }
+    if (size_ - offset_ < kRecordHeaderLen) {
+        is_truncated_ = true;
+        return false;
+    }
+
+    const u_char* record = data_ + offset_;
+    const uint32_t caplen = ReadUint32(record + 8);
+    if (size_ - offset_ - kRecordHeaderLen < caplen) {
+        is_truncated_ = true;
+        return false;
+    }
+
+    pcap_header->ts.tv_sec = ReadUint32(record);
+    pcap_header->ts.tv_usec = ReadUint32(record + 4);
+    if (is_nanosecond_) {
+        pcap_header->ts.tv_usec /= 1000;
+    }
+    pcap_header->caplen = caplen;
+    pcap_header->len = ReadUint32(record + 12);
+
+    *packet = data_ + offset_ + kRecordHeaderLen;
+    offset_ += kRecordHeaderLen + caplen;
+
+    return true;
+}
+
+void MappedPcap::ReleaseConsumed() {
+    // Keep the page the next record starts in
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t consumed = (offset_ - offset_ % page_size);
+    if (consumed < released_offset_ + kReleaseChunkLen) {
+        return;
+    }
+
+    madvise(data_ + released_offset_, consumed - released_offset_,
+            MADV_DONTNEED);
+    released_offset_ = consumed;
+}
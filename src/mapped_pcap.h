@@ -0,0 +1,80 @@
+#ifndef MAPPED_PCAP_H_
+#define MAPPED_PCAP_H_
+
+#include <functional>
+#include <memory>
+#include <pcap.h>
+
+// Classic PCAP file that is memory-mapped instead of read through libpcap.
+// Packets handed out by Next() point straight into the mapping, so nothing is
+// copied at ingest. The mapping is private (copy-on-write), i.e. changes made
+// to the packet bytes never reach the file.
+class MappedPcap {
+    public:
+        // Maps the given file. Returns nullptr if the file cannot be mapped or
+        // is not a classic PCAP file (e.g. pcapng), in which case the caller
+        // should fall back to libpcap
+        static std::unique_ptr<MappedPcap> Open(const char* filename);
+
+        // Maps anonymous memory of the given size and fills it with a capture
+        // via the given function (e.g. from an archive). Returns nullptr if
+        // the function fails or the capture is not a classic PCAP file
+        static std::unique_ptr<MappedPcap> Load(size_t size,
+                const std::function<bool(u_char* data)>& read);
+
+        ~MappedPcap();
+
+        MappedPcap(const MappedPcap&) = delete;
+        MappedPcap& operator=(const MappedPcap&) = delete;
+
+        inline int datalink_type() const {
+            return datalink_type_;
+        }
+        inline bool is_truncated() const {
+            return is_truncated_;
+        }
+
+        // Fills in the header of the next packet and points the packet at its
+        // captured bytes inside the mapping. Returns FALSE at the end of the
+        // file or if the next record is truncated (see is_truncated())
+        bool Next(struct pcap_pkthdr* pcap_header, u_char** packet);
+
+        // Hints that the bytes of all records returned by Next() so far are not
+        // needed anymore, so their pages can be dropped from memory. Pages are
+        // released in large chunks, so this is cheap to call for each record
+        void ReleaseConsumed();
+
+    private:
+        MappedPcap(u_char* data, size_t size);
+
+        // Parses the global file header. Returns FALSE if this is not a
+        // classic PCAP file
+        bool ParseFileHeader();
+
+        inline uint32_t ReadUint32(const u_char* data) const {
+            const uint32_t value = *reinterpret_cast<const uint32_t*>(data);
+            return is_swapped_ ? __builtin_bswap32(value) : value;
+        }
+
+        u_char* data_;
+        size_t size_;
+
+        // Offset of the next record header
+        size_t offset_ = 0;
+
+        // Offset up to which pages were released (see ReleaseConsumed())
+        size_t released_offset_ = 0;
+
+        int datalink_type_ = 0;
+
+        // TRUE, if the file was written on a machine with different byte order
+        bool is_swapped_ = false;
+
+        // TRUE, if the timestamps carry nanoseconds instead of microseconds
+        bool is_nanosecond_ = false;
+
+        // TRUE, if the file ended in the middle of a record
+        bool is_truncated_ = false;
+};
+
+#endif  /* MAPPED_PCAP_H_ */
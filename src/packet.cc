@@ -1,6 +1,5 @@
 #include "packet.h"
 
-#include <cstring>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -8,50 +7,25 @@
 #include "ip_packet.h"
 #include "tcp_packet.h"
 
-Packet::Packet(const u_char* packet, const struct pcap_pkthdr* pcap_header)
-        : packet_(nullptr),
-          ethernet_(nullptr),
-          caplen_(pcap_header->caplen) {
-    packet_ = std::make_unique<u_char[]>(caplen_);
-    memcpy((void*) packet_.get(), (void*) packet, caplen_);
-
-    ethernet_ = std::make_unique<EthernetPacket>(packet_.get(), caplen_);
-    timestamp_us_ = pcap_header->ts.tv_sec * 1E6 + pcap_header->ts.tv_usec;
-}
-
 Packet::Packet(const Packet& packet)
-        : packet_(nullptr),
-          ethernet_(nullptr),
+        : packet_(packet.packet_),
+          ethernet_(packet.ethernet_),
           caplen_(packet.caplen_) {
-    packet_ = std::make_unique<u_char[]>(caplen_);
-    memcpy((void*) packet_.get(), (void*) packet.packet_.get(), caplen_);
-
-    ethernet_ = std::make_unique<EthernetPacket>(packet_.get(), caplen_);
-
     timestamp_us_ = packet.timestamp_us_;
 }
 
-Packet* Packet::CopyAndCut(const uint32_t offset,
-        const uint32_t data_len) const {
-    Packet* new_packet = new Packet(*this); 
-    new_packet->ethernet_->Cut(offset, data_len);
-    return new_packet;
-}
-
-EthernetPacket* Packet::ethernet() const {
-    return ethernet_.get();
-}
-
-IpPacket* Packet::ip() const {
-    return ethernet_->ip();
+Packet::Packet(const Packet& packet, u_char* packet_copy, uint32_t caplen)
+        : packet_(packet_copy),
+          ethernet_(packet.ethernet_, packet_copy, caplen),
+          caplen_(caplen) {
+    timestamp_us_ = packet.timestamp_us_;
 }
 
-TcpPacket* Packet::tcp() const {
-    if (ethernet_->ip() != nullptr) {
-        return ethernet_->ip()->tcp();
-    } else {
-        return nullptr;
-    }
+Packet* Packet::CopyAndCut(const uint32_t offset, const uint32_t data_len,
+        Arena* arena) const {
+    Packet* new_packet = arena->Make<Packet>(*this);
+    new_packet->ethernet_.Cut(offset, data_len);
+    return new_packet;
 }
 
 bool Packet::IsLost() const {
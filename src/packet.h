@@ -1,7 +1,6 @@
 #ifndef PACKET_H_
 #define PACKET_H_
 
-#include <memory>
 #include <pcap.h>
 #include <net/ethernet.h>
 #include <netinet/ip.h>
@@ -9,20 +8,60 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
+#include "arena.h"
 #include "ethernet_packet.h"
 
+// A captured packet and its parsed protocol layers. The layers are embedded,
+// so each packet is a single object (usually allocated in its flow's arena).
+// Packets never own their captured bytes, these either point into a
+// memory-mapped capture file or were copied into an arena as well
 class Packet {
     public:
-        Packet(const u_char* packet, const struct pcap_pkthdr* pcap_header);
+        // Parses the captured packet, which wraps the given bytes directly.
+        // The bytes have to outlive this object
+        template<int kDatalinkType>
+        Packet(u_char* packet, const struct pcap_pkthdr* pcap_header,
+                LinkType<kDatalinkType> link_type);
 
+        // Copies the parsed packet (but not its analysis state). The copy wraps
+        // the same bytes
         explicit Packet(const Packet& packet);
 
-        EthernetPacket* ethernet() const;
-        IpPacket* ip() const;
-        TcpPacket* tcp() const;
+        // Parses the given bytes, which carry a copy of the first caplen bytes
+        // of the given packet (but not its analysis state)
+        Packet(const Packet& packet, u_char* packet_copy, uint32_t caplen);
+
+        inline const EthernetPacket* ethernet() const {
+            return &ethernet_;
+        }
+        inline EthernetPacket* ethernet() {
+            return &ethernet_;
+        }
+        inline const IpPacket* ip() const {
+            return ethernet_.ip();
+        }
+        inline IpPacket* ip() {
+            return ethernet_.ip();
+        }
+        inline const TcpPacket* tcp() const {
+            const IpPacket* ip = ethernet_.ip();
+            return ip != nullptr ? ip->tcp() : nullptr;
+        }
+        inline TcpPacket* tcp() {
+            IpPacket* ip = ethernet_.ip();
+            return ip != nullptr ? ip->tcp() : nullptr;
+        }
 
         inline u_char* packet() const {
-            return packet_.get();
+            return packet_;
+        }
+        inline uint32_t caplen() const {
+            return caplen_;
+        }
+        // Number of captured bytes preceding the TCP payload (i.e. all headers
+        // including options)
+        inline uint32_t headers_caplen() const {
+            return caplen_ - tcp()->captured_data_len();
         }
         inline bool is_tcp() const {
             return tcp() != nullptr;
@@ -33,6 +72,9 @@ class Packet {
         inline uint32_t index() const {
             return index_;
         }
+        inline uint32_t position() const {
+            return position_;
+        }
         inline Packet* next_packet() const {
             return next_packet_;
         }
@@ -60,6 +102,9 @@ class Packet {
         inline void set_index(const uint32_t index) {
             index_ = index;
         }
+        inline void set_position(const uint32_t position) {
+            position_ = position;
+        }
         inline void set_next_packet(Packet* packet) {
             next_packet_ = packet;
         }
@@ -88,18 +133,27 @@ class Packet {
 
         bool IsFromSameEndpoint(const Packet& packet) const;
 
-        Packet* CopyAndCut(const uint32_t offset,
-                const uint32_t data_len) const;
+        // Returns a slice of this packet (allocated in the given arena) that
+        // only carries the given part of the payload. The slice shares this
+        // packet's bytes and only overrides the decoded sequence number and
+        // lengths
+        Packet* CopyAndCut(const uint32_t offset, const uint32_t data_len,
+                Arena* arena) const;
 
     private:
-        std::unique_ptr<u_char[]> packet_;
-        std::unique_ptr<EthernetPacket> ethernet_;
+        // Captured bytes (not owned)
+        u_char* packet_;
+
+        EthernetPacket ethernet_;
 
         uint32_t caplen_;
 
         uint64_t timestamp_us_ = 0;
         uint32_t index_ = 0;
 
+        // Position among the packets transmitted by the same endpoint
+        uint32_t position_ = 0;
+
         Packet* next_packet_ = nullptr;
         Packet* previous_packet_ = nullptr;
         Packet* previous_tx_ = nullptr;
@@ -112,4 +166,13 @@ class Packet {
         uint64_t bytes_passed_ = 0;
 };
 
+template<int kDatalinkType>
+Packet::Packet(u_char* packet, const struct pcap_pkthdr* pcap_header,
+        LinkType<kDatalinkType> link_type)
+        : packet_(packet),
+          ethernet_(packet, pcap_header->caplen, link_type),
+          caplen_(pcap_header->caplen) {
+    timestamp_us_ = pcap_header->ts.tv_sec * 1E6 + pcap_header->ts.tv_usec;
+}
+
 #endif  /* PACKET_H_ */
@@ -0,0 +1,43 @@
+#include "packet_filter.h"
+
+#include <iostream>
+#include <mutex>
+
+// Snapshot length the programs are compiled for. It only bounds the packet
+// offsets a program may read, the captured length is checked at runtime
+constexpr int kSnapLen = 262144;
+
+// Older versions of libpcap compile filters with a non-reentrant parser
+static std::mutex compile_mutex;
+
+std::unique_ptr<PacketFilter> PacketFilter::Compile(
+        const std::string& expression, int datalink_type) {
+    pcap_t* pcap_handle = pcap_open_dead(datalink_type, kSnapLen);
+    if (pcap_handle == NULL) {
+        std::cerr << "pcap_open_dead() failed" << std::endl;
+        return nullptr;
+    }
+
+    struct bpf_program program;
+    int result;
+    {
+        std::lock_guard<std::mutex> lock(compile_mutex);
+        result = pcap_compile(pcap_handle, &program, expression.c_str(), 1,
+                PCAP_NETMASK_UNKNOWN);
+    }
+    if (result < 0) {
+        std::cerr << "pcap_compile() failed for \"" << expression << "\": "
+                  << pcap_geterr(pcap_handle) << std::endl;
+        pcap_close(pcap_handle);
+        return nullptr;
+    }
+    pcap_close(pcap_handle);
+
+    std::unique_ptr<PacketFilter> filter(new PacketFilter());
+    filter->program_ = program;
+    return filter;
+}
+
+PacketFilter::~PacketFilter() {
+    pcap_freecode(&program_);
+}
@@ -0,0 +1,35 @@
+#ifndef PACKET_FILTER_H_
+#define PACKET_FILTER_H_
+
+#include <memory>
+#include <pcap.h>
+#include <string>
+
+// Capture filter expression (in pcap-filter syntax, e.g. "tcp port 3010")
+// compiled to a BPF program for a given datalink type. The program runs on the
+// raw captured bytes, so records can be dropped before any Packet is parsed
+class PacketFilter {
+    public:
+        // Compiles the expression for captures of the given datalink type.
+        // Returns nullptr (and prints the reason) if the expression is invalid
+        static std::unique_ptr<PacketFilter> Compile(
+                const std::string& expression, int datalink_type);
+
+        ~PacketFilter();
+
+        PacketFilter(const PacketFilter&) = delete;
+        PacketFilter& operator=(const PacketFilter&) = delete;
+
+        // Returns TRUE if the captured packet matches the expression
+        inline bool Matches(const struct pcap_pkthdr* pcap_header,
+                const u_char* packet) const {
+            return pcap_offline_filter(&program_, pcap_header, packet) != 0;
+        }
+
+    private:
+        PacketFilter() = default;
+
+        struct bpf_program program_;
+};
+
+#endif  /* PACKET_FILTER_H_ */
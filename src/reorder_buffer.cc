@@ -0,0 +1,67 @@
+#include "reorder_buffer.h"
+
+#include <algorithm>
+
+ReorderBuffer::ReorderBuffer(size_t window, bool headers_only,
+        const ReleaseFunction& release)
+        : window_(window),
+          headers_only_(headers_only),
+          release_(release) {}
+
+bool ReorderBuffer::Add(Packet* packet, bool copy_bytes) {
+    if (window_ == 0) {
+        return release_(packet, copy_bytes);
+    }
+
+    const uint64_t timestamp_us = packet->timestamp_us();
+    if (timestamp_us < max_timestamp_us_) {
+        num_reordered_++;
+    }
+    max_timestamp_us_ = std::max(max_timestamp_us_, timestamp_us);
+    if (timestamp_us < released_timestamp_us_) {
+        num_late_++;
+        is_overflowed_ = true;
+    }
+
+    // The bytes of the source may be gone by the time the packet is released
+    uint32_t copy_len = 0;
+    if (headers_only_) {
+        copy_len = packet->headers_caplen();
+    } else if (copy_bytes) {
+        copy_len = packet->caplen();
+    }
+    heap_.push_back({timestamp_us, sequence_++,
+            std::make_unique<BufferedPacket>(*packet, copy_len)});
+    std::push_heap(heap_.begin(), heap_.end(), IsLater);
+
+    if (!is_overflowed_ && heap_.size() > window_) {
+        return ReleaseFirst();
+    }
+    return true;
+}
+
+bool ReorderBuffer::Flush() {
+    while (!heap_.empty()) {
+        if (!ReleaseFirst()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReorderBuffer::ReleaseFirst() {
+    std::pop_heap(heap_.begin(), heap_.end(), IsLater);
+    Entry entry = std::move(heap_.back());
+    heap_.pop_back();
+
+    released_timestamp_us_ = std::max(released_timestamp_us_,
+            entry.timestamp_us_);
+    return release_(entry.packet_->packet(), entry.packet_->is_copy());
+}
+
+bool ReorderBuffer::IsLater(const Entry& a, const Entry& b) {
+    if (a.timestamp_us_ == b.timestamp_us_) {
+        return a.sequence_ > b.sequence_;
+    }
+    return a.timestamp_us_ > b.timestamp_us_;
+}
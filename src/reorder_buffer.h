@@ -0,0 +1,91 @@
+#ifndef REORDER_BUFFER_H_
+#define REORDER_BUFFER_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "buffered_packet.h"
+#include "packet.h"
+
+// Restores the timestamp order of packets that were captured slightly out of
+// order (e.g. by multiple NIC queues), since the flow analysis relies on
+// timestamp-ordered packets. Packets are held back in a min-heap keyed on their
+// timestamp (ties keep the capture order) and released once more than window
+// packets are buffered.
+// If a packet arrives after packets with a later timestamp were released, the
+// window overflowed. From then on, no packet is released until the end of the
+// capture, i.e. all remaining packets are fully sorted (only the packets that
+// overflowed the window stay out of order)
+class ReorderBuffer {
+    public:
+        // Function that is handed each released packet (see
+        // TcpFlowMap::AddPacket()). Processing stops once it returns FALSE
+        typedef std::function<bool(Packet* packet, bool copy_bytes)>
+            ReleaseFunction;
+
+        // If the window is 0, packets are released right away. If
+        // headers_only is TRUE, buffered packets only keep their headers
+        ReorderBuffer(size_t window, bool headers_only,
+                const ReleaseFunction& release);
+
+        inline uint64_t num_reordered() const {
+            return num_reordered_;
+        }
+        inline uint64_t num_late() const {
+            return num_late_;
+        }
+        inline bool is_overflowed() const {
+            return is_overflowed_;
+        }
+
+        // Adds a packet and releases the first buffered packet if the window
+        // is full. If copy_bytes is TRUE, the packet's bytes are only valid
+        // during this call. Returns the result of the release function (TRUE
+        // if nothing was released)
+        bool Add(Packet* packet, bool copy_bytes);
+
+        // Releases all buffered packets
+        bool Flush();
+
+    private:
+        typedef struct {
+            uint64_t timestamp_us_;
+            uint64_t sequence_;
+            std::unique_ptr<BufferedPacket> packet_;
+        } Entry;
+
+        // Orders the heap so that the entry with the earliest timestamp (and
+        // the earliest capture order among equal timestamps) comes first
+        static bool IsLater(const Entry& a, const Entry& b);
+
+        // Releases the buffered packet with the earliest timestamp
+        bool ReleaseFirst();
+
+        const size_t window_;
+        const bool headers_only_;
+        const ReleaseFunction release_;
+
+        // Min-heap of all buffered packets
+        std::vector<Entry> heap_;
+
+        // Running number of added packets (to keep the capture order of
+        // packets with the same timestamp)
+        uint64_t sequence_ = 0;
+
+        // Latest timestamp of all added (released) packets
+        uint64_t max_timestamp_us_ = 0;
+        uint64_t released_timestamp_us_ = 0;
+
+        // Number of packets with an earlier timestamp than a packet added
+        // before them
+        uint64_t num_reordered_ = 0;
+
+        // Number of packets that arrived after a packet with a later
+        // timestamp was already released
+        uint64_t num_late_ = 0;
+
+        bool is_overflowed_ = false;
+};
+
+#endif  /* REORDER_BUFFER_H_ */
@@ -0,0 +1,135 @@
+#include "sharded_flow_map.h"
+
+#include <algorithm>
+
+#include "ip_packet.h"
+#include "tcp_packet.h"
+
+const size_t ShardedFlowMap::kQueueCapacity = 1024;
+
+ShardedFlowMap::Shard::Shard(bool headers_only)
+        : flow_map_(headers_only),
+          queue_(kQueueCapacity) {}
+
+ShardedFlowMap::ShardedFlowMap(size_t num_shards, bool headers_only)
+        : headers_only_(headers_only),
+          is_done_(false),
+          is_bogus_(false) {
+    for (size_t i = 0; i < std::max<size_t>(num_shards, 1); i++) {
+        shards_.push_back(std::make_unique<Shard>(headers_only));
+    }
+    for (auto& shard : shards_) {
+        shard->thread_ = std::thread(&ShardedFlowMap::RunShard, this,
+                shard.get());
+    }
+}
+
+ShardedFlowMap::~ShardedFlowMap() {
+    Finish();
+}
+
+bool ShardedFlowMap::AddPacket(Packet* packet, bool copy_bytes) {
+    packet->set_index(index_++);
+
+    const TcpFlowId flow_id = {
+        packet->ip()->src_addr(),
+        packet->ip()->dst_addr(),
+        packet->tcp()->src_port(),
+        packet->tcp()->dst_port()
+    };
+    Shard* shard = shards_[GetShardIndex(flow_id)].get();
+
+    // The shard copies the packet (and its bytes) once more into the arena of
+    // its flow, so only bytes that may vanish before that are copied here
+    uint32_t copy_len = 0;
+    if (headers_only_) {
+        copy_len = packet->headers_caplen();
+    } else if (copy_bytes) {
+        copy_len = packet->caplen();
+    }
+    while (!shard->queue_.TryEmplace(*packet, copy_len)) {
+        std::this_thread::yield();
+    }
+
+    return !is_bogus_.load(std::memory_order_relaxed);
+}
+
+bool ShardedFlowMap::Finish() {
+    is_done_.store(true, std::memory_order_release);
+    for (auto& shard : shards_) {
+        if (shard->thread_.joinable()) {
+            shard->thread_.join();
+        }
+    }
+    return !is_bogus_.load();
+}
+
+size_t ShardedFlowMap::num_flows() const {
+    size_t num_flows = 0;
+    for (const auto& shard : shards_) {
+        num_flows += shard->flow_map_.num_flows();
+    }
+    return num_flows;
+}
+
+std::vector<const TcpFlow*> ShardedFlowMap::GetFlows() const {
+    std::vector<const TcpFlow*> flows;
+    for (const auto& shard : shards_) {
+        auto shard_flows = shard->flow_map_.GetFlows();
+        flows.insert(flows.end(), shard_flows.begin(), shard_flows.end());
+    }
+    std::sort(flows.begin(), flows.end(),
+            [](const TcpFlow* a, const TcpFlow* b) {
+        return a->id() < b->id();
+    });
+    return flows;
+}
+
+void ShardedFlowMap::ProcessFlows(const IndexedFlowCallback& function) const {
+    // Assign the global flow indices before handing each shard its flows
+    std::vector<std::vector<std::pair<uint32_t, const TcpFlow*>>> shard_flows(
+            shards_.size());
+    uint32_t flow_index = 0;
+    for (const TcpFlow* flow : GetFlows()) {
+        shard_flows[GetShardIndex(flow->id())].push_back({flow_index++, flow});
+    }
+
+    std::vector<std::thread> threads;
+    for (const auto& flows : shard_flows) {
+        threads.emplace_back([&function, &flows]() {
+            for (const auto& indexed_flow : flows) {
+                function(indexed_flow.first, *indexed_flow.second);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+size_t ShardedFlowMap::GetShardIndex(const TcpFlowId& flow_id) const {
+    // The flow tables of the shards use the lower bits of the same hash
+    return (flow_id.Canonical().Hash() >> 32) % shards_.size();
+}
+
+void ShardedFlowMap::RunShard(Shard* shard) {
+    while (true) {
+        BufferedPacket* queued_packet = shard->queue_.Front();
+        if (queued_packet == nullptr) {
+            // Only stop once the queue is still empty after the reader is done
+            if (is_done_.load(std::memory_order_acquire) &&
+                    shard->queue_.Front() == nullptr) {
+                return;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (!is_bogus_.load(std::memory_order_relaxed) &&
+                !shard->flow_map_.AddIndexedPacket(*queued_packet->packet(),
+                    queued_packet->is_copy())) {
+            is_bogus_.store(true, std::memory_order_relaxed);
+        }
+        shard->queue_.Pop();
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef SHARDED_FLOW_MAP_H_
+#define SHARDED_FLOW_MAP_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <pcap.h>
+#include <thread>
+#include <vector>
+
+#include "buffered_packet.h"
+#include "mapped_pcap.h"
+#include "packet.h"
+#include "spsc_ring.h"
+#include "tcp_flow.h"
+#include "tcp_flow_map.h"
+
+// Flow map that builds its flows on multiple threads. The reading thread
+// hashes the canonical 4-tuple of each packet and hands the packet over a
+// SpscRing to the worker thread of the matching shard. Each shard owns a
+// TcpFlowMap with a disjoint set of flows, so the packets of a flow are still
+// processed in order and shards don't share any state
+class ShardedFlowMap {
+    public:
+        // Number of packets that can be queued for each shard
+        static const size_t kQueueCapacity;
+
+        typedef std::function<void(uint32_t flow_index, const TcpFlow& flow)>
+            IndexedFlowCallback;
+
+        // Starts one worker thread per shard. If headers_only is TRUE, packets
+        // only keep their header bytes (see TcpFlowMap)
+        ShardedFlowMap(size_t num_shards, bool headers_only);
+
+        // Stops the worker threads (if not done by Finish() yet)
+        ~ShardedFlowMap();
+
+        ShardedFlowMap(const ShardedFlowMap&) = delete;
+        ShardedFlowMap& operator=(const ShardedFlowMap&) = delete;
+
+        // Hands a new packet to the shard of its flow, which adds it like
+        // TcpFlowMap::AddPacket(). Packet indices are assigned here, so they
+        // match those of a single TcpFlowMap.
+        // Returns FALSE, if any shard saw an indication of bogus data so far
+        bool AddPacket(Packet* packet, bool copy_bytes);
+
+        // Waits until all queued packets are processed and stops the worker
+        // threads. Returns FALSE, if any shard saw an indication of bogus data
+        bool Finish();
+
+        size_t num_flows() const;
+
+        // Returns the flows of all shards ordered by their TcpFlowId (i.e. the
+        // same order as TcpFlowMap::GetFlows() for the same packets)
+        std::vector<const TcpFlow*> GetFlows() const;
+
+        // Calls the function for each flow and its index in GetFlows(). The
+        // flows of each shard are processed on a separate thread, so the
+        // function has to be thread-safe. Only valid after Finish()
+        void ProcessFlows(const IndexedFlowCallback& function) const;
+
+    private:
+        struct Shard {
+            explicit Shard(bool headers_only);
+
+            TcpFlowMap flow_map_;
+            SpscRing<BufferedPacket> queue_;
+            std::thread thread_;
+        };
+
+        // Returns the shard that owns the flow with the given ID
+        size_t GetShardIndex(const TcpFlowId& flow_id) const;
+
+        // Adds the queued packets of the shard to its flow map until the
+        // reader is done
+        void RunShard(Shard* shard);
+
+        // Memory-mapped capture the packets in this map point into (if any).
+        // Declared before the shards so that it is unmapped after them
+        std::unique_ptr<MappedPcap> mapped_pcap_;
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+
+        const bool headers_only_;
+
+        // Running index for packets added to the map
+        uint32_t index_ = 0;
+
+        // Set once the reader added the last packet
+        std::atomic<bool> is_done_;
+
+        // Set once any shard saw an indication of bogus data. Further packets
+        // are dropped, as the map is not used in that case
+        std::atomic<bool> is_bogus_;
+
+        friend class TcpFlowMapFactory;
+};
+
+#endif  /* SHARDED_FLOW_MAP_H_ */
@@ -0,0 +1,50 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+// Bounded lock-free ring buffer for exactly one producer and one consumer
+// thread. Elements are constructed in place and stay at the same address until
+// they are popped, so they may hold pointers to themselves
+template<typename T>
+class SpscRing {
+    public:
+        // The capacity is rounded up to the next power of two
+        explicit SpscRing(size_t capacity);
+        ~SpscRing();
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        // Producer: constructs a new element at the end of the ring. Returns
+        // FALSE (without constructing anything) if the ring is full
+        template<typename... Args>
+        bool TryEmplace(Args&&... args);
+
+        // Consumer: returns the first element or nullptr if the ring is empty
+        T* Front();
+
+        // Consumer: destroys the first element. The ring must not be empty
+        void Pop();
+
+    private:
+        typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+        // Returns the smallest power of two that is at least the given value
+        static size_t RoundUpToPowerOfTwo(size_t value);
+
+        std::unique_ptr<Slot[]> slots_;
+        const size_t mask_;
+
+        // Positions keep growing and are mapped to slots by the mask. Both are
+        // kept on separate cache lines, so that producer and consumer don't
+        // invalidate each other's line on every operation
+        alignas(64) std::atomic<size_t> head_;  // next element to consume
+        alignas(64) std::atomic<size_t> tail_;  // next slot to fill
+};
+
+#include "spsc_ring.tcc"
+
+#endif  /* SPSC_RING_H_ */
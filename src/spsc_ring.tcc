@@ -0,0 +1,53 @@
+#include <new>
+#include <utility>
+
+template<typename T>
+size_t SpscRing<T>::RoundUpToPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity)
+        : slots_(new Slot[RoundUpToPowerOfTwo(capacity)]),
+          mask_(RoundUpToPowerOfTwo(capacity) - 1),
+          head_(0),
+          tail_(0) {}
+
+template<typename T>
+SpscRing<T>::~SpscRing() {
+    while (Front() != nullptr) {
+        Pop();
+    }
+}
+
+template<typename T>
+template<typename... Args>
+bool SpscRing<T>::TryEmplace(Args&&... args) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) > mask_) {
+        return false;
+    }
+    new (&slots_[tail & mask_]) T(std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+T* SpscRing<T>::Front() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return reinterpret_cast<T*>(&slots_[head & mask_]);
+}
+
+template<typename T>
+void SpscRing<T>::Pop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    reinterpret_cast<T*>(&slots_[head & mask_])->~T();
+    head_.store(head + 1, std::memory_order_release);
+}
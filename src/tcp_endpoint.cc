@@ -11,9 +11,14 @@
 
 constexpr uint64_t TcpEndpoint::kMaxTriggerPacketDelayUs = 2000;
 
-TcpEndpoint::TcpEndpoint(Packet* packet)
+// Unwrapped sequence numbers start at 2^32 plus the initial sequence number, so
+// that they keep its lower 32 bits and earlier sequence numbers stay positive
+constexpr uint64_t kUnwrappedSeqBase = 1ULL << 32;
+
+TcpEndpoint::TcpEndpoint(Packet* packet, Arena* arena)
         : addr_(packet->ip()->src_addr()),
-          port_(packet->tcp()->src_port()) {
+          port_(packet->tcp()->src_port()),
+          arena_(arena) {
     current_packet_ = packet;
     SetInitialSequenceNumbers();        
 }
@@ -23,7 +28,8 @@ void TcpEndpoint::SetInitialSequenceNumbers() {
     const bool ack_flag_set = tcp.flags() & TH_ACK;
 
     if (!seq_init_) {
-        seq_acked_ = seq_init_ = tcp.seq();
+        seq_init_ = tcp.seq();
+        seq_acked_ = unwrapped_seq_init_ = kUnwrappedSeqBase + seq_init_;
         seq_next_ = seq_acked_ + 1;
     }
     if (!ack_init_ && ack_flag_set) {
@@ -63,6 +69,7 @@ std::vector<Packet*> TcpEndpoint::AddPacket(Packet* packet, bool process_packet)
         current_packet_ = wire_packet;
         TcpPacket* wire_tcp = wire_packet->tcp();
         wire_tcp->SetRelativeSeqAndAck(seq_init_, ack_init_);
+        wire_tcp->unwrapped_seq_ = tcp_util::Unwrap(wire_tcp->seq(), seq_next_);
         wire_tcp->acked_bytes_ = acked_bytes_;
 
         // Update state for packets requiring ACKs, i.e. data packets and
@@ -72,11 +79,11 @@ std::vector<Packet*> TcpEndpoint::AddPacket(Packet* packet, bool process_packet)
         if (process_packet && wire_tcp->RequiresAck()) {
             if (wire_tcp->data_len()) {
                 bool seq_moved = false;
-                if (tcp_util::After(wire_tcp->seq_end(), seq_next_)) {
-                    seq_next_ = wire_tcp->seq_end();
+                if (wire_tcp->unwrapped_seq_end() > seq_next_) {
+                    seq_next_ = wire_tcp->unwrapped_seq_end();
                     seq_moved = true;
                 }
-                if (rto_high_seq_ && tcp_util::After(seq_next_, rto_high_seq_)) {
+                if (rto_high_seq_ && seq_next_ > rto_high_seq_) {
                     rto_high_seq_ = 0;
                 }
                 if (!seq_moved || rto_high_seq_) {
@@ -96,12 +103,18 @@ std::vector<Packet*> TcpEndpoint::AddPacket(Packet* packet, bool process_packet)
                 }
             }
 
-            unacked_packets_.push_back(wire_packet);
+            unacked_packets_.Add(wire_packet);
+            num_in_flight_ += 1;
             if (rto_.armed_by_ == nullptr) {
                 ArmTimers(current_packet_);
             }
         }
+        wire_packet->set_position(packets_.size());
         packets_.push_back(wire_packet);
+        unacked_bytes_offsets_.Append();
+        if (process_packet) {
+            tx_index_.Add(wire_packet);
+        }
     }
 
     return wire_packets;
@@ -113,17 +126,8 @@ void TcpEndpoint::ArmTimers(const Packet* packet) {
     rto_.backoffs_ = num_rtos_;
     tlp_.armed_by_ = packet;
 
-    bool delayed_ack = false;
-    for (Packet* packet : unacked_packets_) {
-        if (!packet->IsLost()) {
-            if (delayed_ack) {
-                delayed_ack = false;
-                break;
-            } else {
-                delayed_ack = true;
-            }
-        }
-    }
+    // The delayed ACK timer matters if there is only a single packet in flight
+    const bool delayed_ack = num_in_flight_ == 1;
     tlp_.delay_us_ = timer_.GetTLP(delayed_ack);
     tlp_.delayed_ack_ = delayed_ack;
 }
@@ -171,7 +175,7 @@ std::vector<Packet*> TcpEndpoint::SplitIntoWirePackets() {
     while (offset < data_len) {
         uint32_t current_data_len = std::min(mss_, data_len - offset);
         Packet* new_packet =
-            current_packet_->CopyAndCut(offset, current_data_len);
+            current_packet_->CopyAndCut(offset, current_data_len, arena_);
         wire_packets.push_back(new_packet);
         offset += current_data_len;
     }
@@ -181,13 +185,14 @@ std::vector<Packet*> TcpEndpoint::SplitIntoWirePackets() {
 
 void TcpEndpoint::AdjustUnackedBytesCountsAfter(
         const Packet& packet, int32_t offset) {
-    for (auto it = packets_.rbegin(); it != packets_.rend(); ++it) {
-        Packet* current_packet = *it;
-        if (current_packet == &packet) {
-            return;
-        }
-        current_packet->tcp()->unacked_bytes_ += offset;
-    }
+    // If the given packet was not transmitted by this endpoint (e.g. an ACK),
+    // all packets are adjusted
+    const uint32_t position = packet.position();
+    uint32_t first = 0;
+    if (position < packets_.size() && packets_[position] == &packet) {
+        first = position + 1;
+    }
+    unacked_bytes_offsets_.AddFrom(first, offset);
 }
 
 bool TcpEndpoint::TiePacketToSackLookalike(Packet* packet) {
@@ -200,7 +205,8 @@ bool TcpEndpoint::TiePacketToSackLookalike(Packet* packet) {
             VLOG(3) << "Seq " << packet->tcp()->seq()
                     << ": tied to SACK lookalike (ack: " << possible_sack->tcp()->ack() << ")";
             HandleAckedPacket(packet, possible_sack);
-            sacks_.Add({packet->tcp()->seq(), packet->tcp()->seq_end()});
+            sacks_.Add({packet->tcp()->unwrapped_seq(),
+                        packet->tcp()->unwrapped_seq_end()});
             if (!last_ack_with_trigger_ ||
                     possible_sack->timestamp_us() >
                     last_ack_with_trigger_->timestamp_us()) {
@@ -230,14 +236,15 @@ void TcpEndpoint::CheckForSacksFromLookalikes() {
          it != unacked_packets_.end() && !unused_sack_lookalikes_.empty(); ) {
         Packet* unacked_packet = *it;
         TcpPacket* tcp = unacked_packet->tcp();
-        if (!tcp_util::After(current_packet_->tcp()->seq(), tcp->seq())) {
+        if (current_packet_->tcp()->unwrapped_seq() <= tcp->unwrapped_seq()) {
             return;
         } else if (!unacked_packet->IsLost() &&
                    unacked_packet->previous_tx() == nullptr) {
             if (!TiePacketToSackLookalike(unacked_packet)) {
                 return;
             }
-            it = unacked_packets_.erase(it);
+            it = unacked_packets_.Erase(it);
+            num_in_flight_ -= 1;
         } else {
             ++it;
         }
@@ -277,7 +284,7 @@ bool TcpEndpoint::CheckForTLP() {
     // The TLP carries at least the highest previously transmitted sequence
     // (this is true, since we are only getting here for retransmitted packets,
     // i.e. the cases where the TLP carries new data are not covered here)
-    if (current_packet_->tcp()->seq_end() != seq_next_) {
+    if (current_packet_->tcp()->unwrapped_seq_end() != seq_next_) {
         return false;
     }
 
@@ -304,7 +311,8 @@ bool TcpEndpoint::CheckForRTO() {
     if (rto_.armed_by_ == nullptr) {
         return false;
     }
-    const Packet* armer = rto_.armed_by_;
+    // The armer is one of our own packets, so we may update its annotations
+    Packet* armer = const_cast<Packet*>(rto_.armed_by_);
 
     // Compare this packet's timestamp with the estimated timestamp for the RTO
     // event. Since different stacks compute the RTO differently we only require
@@ -407,49 +415,41 @@ bool TcpEndpoint::FindRtxTrigger() {
 }
 
 bool TcpEndpoint::LinkToPreviousTx() {
-    const TcpPacket& tcp = *(current_packet_->tcp());
-    
-    // Search from the back for the most recent transmission that covers at the
-    // least the starting sequence of the current packet
-    for (auto rev_iter = packets_.rbegin();
-            rev_iter != packets_.rend(); ++rev_iter) {
-        Packet* previous_packet = *rev_iter;
-        const TcpPacket& previous_tcp = *(previous_packet->tcp());
-        
-        if (tcp.seq() == previous_tcp.seq() ||
-            tcp_util::Between(tcp.seq(), previous_tcp.seq(),
-                previous_tcp.seq_end())) {
-            // Found earlier transmission
-            previous_packet->set_rtx(current_packet_);
-            current_packet_->set_previous_tx(previous_packet);
-            current_packet_->set_first_tx(previous_packet->first_tx());
-
-            // Set retransmission delays and attempt counts for the
-            // previous matching transmissions
-            Packet* current_tx = current_packet_;
-            while (current_tx->previous_tx() != nullptr) {
-                current_tx = current_tx->previous_tx();
-                TcpPacket* current_tcp = current_tx->tcp();
-                const uint32_t delay =
-                    current_packet_->timestamp_us() - current_tx->timestamp_us();
-                if (!current_tcp->rtx_delay_us_) {
-                    current_tcp->rtx_delay_us_ = delay;
-                }
+    // Look up the most recent transmission that covers at the least the
+    // starting sequence of the current packet
+    Packet* previous_packet =
+        tx_index_.FindLatestTx(current_packet_->tcp()->seq());
+    if (previous_packet == nullptr) {
+        return false;
+    }
 
-                // If we moved to the original transmission set total
-                // delay and number of attempts as well
-                if (current_tx->previous_tx() == nullptr) {
-                    current_tcp->final_rtx_delay_us_ = delay;
-                    current_tcp->num_rtx_attempts_++;
-                }
-            }
-            return true;
+    // Found earlier transmission
+    const bool was_lost = previous_packet->IsLost();
+    previous_packet->set_rtx(current_packet_);
+    UpdateLossCounts(*previous_packet, was_lost);
+    current_packet_->set_previous_tx(previous_packet);
+    current_packet_->set_first_tx(previous_packet->first_tx());
+
+    // Set retransmission delays and attempt counts for the
+    // previous matching transmissions
+    Packet* current_tx = current_packet_;
+    while (current_tx->previous_tx() != nullptr) {
+        current_tx = current_tx->previous_tx();
+        TcpPacket* current_tcp = current_tx->tcp();
+        const uint32_t delay =
+            current_packet_->timestamp_us() - current_tx->timestamp_us();
+        if (!current_tcp->rtx_delay_us_) {
+            current_tcp->rtx_delay_us_ = delay;
         }
-    }
 
-    // If we get here we have not found any earlier packet that covered
-    // at least the starting sequence
-    return false;
+        // If we moved to the original transmission set total
+        // delay and number of attempts as well
+        if (current_tx->previous_tx() == nullptr) {
+            current_tcp->final_rtx_delay_us_ = delay;
+            current_tcp->num_rtx_attempts_++;
+        }
+    }
+    return true;
 }
 
 void TcpEndpoint::MarkPacketsOutOfOrder() {
@@ -470,20 +470,21 @@ void TcpEndpoint::ProcessAck(Packet* packet) {
 
     // If the ACK number advanced or if the packet carried SACK blocks we check
     // if the unacked packets are now fully acked
-    bool ack_moved = tcp_util::After(tcp->ack(), seq_acked_);
+    tcp->unwrapped_ack_ = tcp_util::Unwrap(tcp->ack(), seq_acked_);
+    bool ack_moved = tcp->unwrapped_ack() > seq_acked_;
     bool has_sacks = !tcp->sacks().empty();
     if (ack_moved) {
-        acked_bytes_ += tcp->ack() - seq_acked_;
-        seq_acked_ = tcp->ack();
-        if (tcp_util::After(seq_acked_, seq_next_)) {
+        acked_bytes_ += tcp->unwrapped_ack() - seq_acked_;
+        seq_acked_ = tcp->unwrapped_ack();
+        if (seq_acked_ > seq_next_) {
             VLOG(1) << "ACK for seq after seq_next (acked: " << seq_acked_
                     << ", next: " << seq_next_ << ")";
             is_bogus_ = true;
         }
-        if (rto_high_seq_ && !tcp_util::Before(seq_acked_, rto_high_seq_)) {
+        if (rto_high_seq_ && seq_acked_ >= rto_high_seq_) {
             rto_high_seq_ = 0;
         }
-    } else if (tcp->ack() == seq_acked_) {
+    } else if (tcp->unwrapped_ack() == seq_acked_) {
         tcp->is_dupack_ = true;
         if (tcp->unknown_option_size() >= 10) {
             // Options are truncated but at least one SACK would fit in here. We
@@ -495,7 +496,7 @@ void TcpEndpoint::ProcessAck(Packet* packet) {
     }
     if (ack_moved || has_sacks) {
         AckPackets();
-        sacks_.Add(tcp->sacks());
+        sacks_.Add(tcp->sacks(), seq_acked_);
         sacks_.RemoveAcked(seq_acked_);
         num_rtos_ = 0;
     }
@@ -534,22 +535,18 @@ void TcpEndpoint::HandleAckedPacket(Packet* packet, Packet* ack) {
 }
 
 void TcpEndpoint::AckPackets() {
-    std::vector<Packet*> remaining_unacked_packets;
-    const TcpSacks& sacks = current_packet_->tcp()->sacks();
-    bool acked_data = false;
-
-    for (Packet* unacked_packet : unacked_packets_) {
-        TcpPacket* tcp = unacked_packet->tcp();
-        if (!tcp_util::After(tcp->seq_end(), seq_acked_) ||
-            tcp->IsSacked(sacks)) {
-            // Packet is ACKed (or SACKed)
-            acked_data = true;
-            HandleAckedPacket(unacked_packet, last_ack_);
-        } else {
-            remaining_unacked_packets.push_back(unacked_packet);
+    // Handle the packets that are now ACKed (or SACKed) in the order they
+    // were transmitted (the scoreboard works on wire sequence numbers, i.e. on
+    // the lower 32 bits)
+    unacked_packets_.RemoveAcked(static_cast<uint32_t>(seq_acked_),
+            current_packet_->tcp()->sacks(), &acked_packets_);
+    for (Packet* acked_packet : acked_packets_) {
+        if (!acked_packet->IsLost()) {
+            num_in_flight_ -= 1;
         }
+        HandleAckedPacket(acked_packet, last_ack_);
     }
-    unacked_packets_ = remaining_unacked_packets;
+    const bool acked_data = !acked_packets_.empty();
 
     // Reset the TLP and RTO timer if new data was ACKed,
     // turn off the RTO timer if there is no more pending data
@@ -564,11 +561,10 @@ void TcpEndpoint::AckPackets() {
 }
 
 void TcpEndpoint::DSackPackets() {
-    uint32_t ack = current_packet_->tcp()->ack();
-    const auto sacks = current_packet_->tcp()->sacks().sacks();
-    for (const Sack sack : sacks) {
-        if (tcp_util::Before(sack.start_, ack) &&
-                !tcp_util::After(sack.end_, ack)) {
+    const uint64_t ack = current_packet_->tcp()->unwrapped_ack();
+    for (const Sack& sack : current_packet_->tcp()->sacks().sacks()) {
+        if (tcp_util::Unwrap(sack.start_, ack) < ack &&
+                tcp_util::Unwrap(sack.end_, ack) <= ack) {
             // DSACK range
             HandleSpuriousRtx(sack.start_, sack.end_);
         }
@@ -576,27 +572,44 @@ void TcpEndpoint::DSackPackets() {
 }
 
 void TcpEndpoint::HandleSpuriousRtx(uint32_t seq_start, uint32_t seq_end) {
-   for (auto rev_iter = packets_.rbegin();
-           rev_iter != packets_.rend(); ++rev_iter) {
-        Packet* packet = *rev_iter;
-        // Find the latest packet that was retransmitted and does not have
-        // a spurious retransmission attached to it already. That is, the
-        // DSACK marks the last retransmission as spurious, the second
-        // DSACK marks the second last retransmission as spurious, etc.
-        if (packet->tcp()->is_rtx() &&
-                !packet->tcp()->is_spurious_rtx() &&
-                tcp_util::RangeIncluded(
-                    seq_start, seq_end,
-                    packet->tcp()->seq(),
-                    packet->tcp()->seq_end())) {
-            packet->tcp()->is_spurious_rtx_ = true;
-            return;
-        }
-   }
+    // Find the latest packet that was retransmitted and does not have
+    // a spurious retransmission attached to it already. That is, the
+    // DSACK marks the last retransmission as spurious, the second
+    // DSACK marks the second last retransmission as spurious, etc.
+    // (the index drops retransmissions once they are returned)
+    Packet* packet = tx_index_.TakeLatestRtx(seq_start, seq_end);
+    if (packet == nullptr) {
+        return;
+    }
+
+    // The earlier transmission is no longer lost, unless it was retransmitted
+    // again afterwards
+    Packet* previous_packet = packet->previous_tx();
+    const bool was_lost =
+        previous_packet != nullptr && previous_packet->IsLost();
+    packet->tcp()->is_spurious_rtx_ = true;
+    if (previous_packet != nullptr) {
+        UpdateLossCounts(*previous_packet, was_lost);
+    }
+}
+
+void TcpEndpoint::UpdateLossCounts(const Packet& packet, bool was_lost) {
+    const bool is_lost = packet.IsLost();
+    if (is_lost == was_lost) {
+        return;
+    }
+    num_losses_ += is_lost ? 1 : -1;
+
+    // Only packets on the scoreboard count as in flight, i.e. the ones that
+    // require an ACK and were not acked yet
+    const TcpPacket& tcp = *(packet.tcp());
+    if (tcp.RequiresAck() && tcp.ack_packet() == nullptr) {
+        num_in_flight_ += is_lost ? -1 : 1;
+    }
 }
 
 uint32_t TcpEndpoint::GetNumLosses() const {
-    return GetCountForNonZeroFunctionValue(&Packet::IsLost);
+    return num_losses_;
 }
 
 uint32_t TcpEndpoint::GetNumDataPackets() const {
@@ -668,70 +681,69 @@ std::vector<std::pair<double, double>>
         TcpEndpoint::GetUnackedBytesRttPairs() const {
     std::vector<std::pair<double, double>> pairs;
     for (const Packet* packet : packets_) {
-        if (!packet->IsLost() && !packet->out_of_order() &&
-                packet->tcp()->ack_delay_us()) {
+        if (IsUnackedBytesRttSample(*packet)) {
             pairs.push_back(std::make_pair(
-                    packet->tcp()->unacked_bytes(),
+                    GetUnackedBytes(*packet),
                     packet->tcp()->ack_delay_us()));
         }
     }
     return pairs;
 }
 
-std::vector<std::pair<double, double>>
-        TcpEndpoint::GetUnackedBytesRttPairsAroundPacket(
-                const Packet& target_packet, uint8_t num_samples,
-                bool use_older_packets_only) const {
-    const uint8_t max_distance =
-        use_older_packets_only ? num_samples : (num_samples / 2);
-    std::vector<std::pair<double, double>> pairs;
-    std::vector<std::pair<double, double>> before_pairs(max_distance);
-    bool seen = false;
-    int index = 0;
-
-    // Fill up a circular buffer with packets preceding the target
-    auto packet_it = packets_.cbegin();
-    for (;packet_it != packets_.cend(); ++packet_it) {
-        const Packet* packet = *packet_it;
-        if (!packet->IsLost() && !packet->out_of_order() &&
-                packet->tcp()->ack_delay_us()) {
-            before_pairs[index % max_distance] = 
-                std::make_pair(
-                        packet->tcp()->unacked_bytes(),
-                        packet->tcp()->ack_delay_us());
-            index++;
-        }
-        if (packet == &target_packet) {
-            seen = true;
-            break;
+void TcpEndpoint::AddUnackedBytesRttSamples(
+        stats_util::LinearFitAccumulator* samples) const {
+    for (const Packet* packet : packets_) {
+        if (IsUnackedBytesRttSample(*packet)) {
+            samples->Add(GetUnackedBytes(*packet),
+                    packet->tcp()->ack_delay_us());
         }
     }
-    if (!seen || !index) {
-        return pairs;
+}
+
+void TcpEndpoint::AddUnackedBytesRttSamplesAroundPacket(
+        const Packet& target_packet, uint8_t num_samples,
+        bool use_older_packets_only,
+        stats_util::LinearFitAccumulator* samples) const {
+    const uint8_t max_distance =
+        use_older_packets_only ? num_samples : (num_samples / 2);
+    const uint32_t position = target_packet.position();
+    if (position >= packets_.size() || packets_[position] != &target_packet) {
+        return;
     }
 
-    int end_index = index - 1;
-    index = std::max(0, index - max_distance);
-    for (int i = index; i <= end_index; i++) {
-        pairs.push_back(before_pairs[i % max_distance]);
+    // Walk back from the target packet (including it) until hitting the max.
+    // distance. Without any of these samples, there is no fit around the
+    // target
+    int seen_before = 0;
+    for (auto packet_it = packets_.cbegin() + position + 1;
+            packet_it != packets_.cbegin() && seen_before < max_distance; ) {
+        const Packet* packet = *(--packet_it);
+        if (IsUnackedBytesRttSample(*packet)) {
+            samples->Add(GetUnackedBytes(*packet),
+                    packet->tcp()->ack_delay_us());
+            seen_before++;
+        }
     }
-    if (use_older_packets_only) {
-        return pairs;
+    if (!seen_before || use_older_packets_only) {
+        return;
     }
 
-    // Found the target packet. Now get the immediately succeeding samples until
-    // hitting the max. distance
+    // Get the immediately succeeding samples (starting with the target packet
+    // again) until hitting the max. distance
     int seen_after = 0;
-    for (; packet_it != packets_.cend() && seen_after < max_distance; ++packet_it) {
+    for (auto packet_it = packets_.cbegin() + position;
+            packet_it != packets_.cend() && seen_after < max_distance;
+            ++packet_it) {
         const Packet* packet = *packet_it;
-        if (!packet->IsLost() && !packet->out_of_order() &&
-                packet->tcp()->ack_delay_us()) {
-            pairs.push_back(std::make_pair(
-                    packet->tcp()->unacked_bytes(),
-                    packet->tcp()->ack_delay_us()));
+        if (IsUnackedBytesRttSample(*packet)) {
+            samples->Add(GetUnackedBytes(*packet),
+                    packet->tcp()->ack_delay_us());
             seen_after++;
         }
     }
+}
 
-    return pairs;
+bool TcpEndpoint::IsUnackedBytesRttSample(const Packet& packet) {
+    return !packet.IsLost() && !packet.out_of_order() &&
+        packet.tcp()->ack_delay_us();
 }
@@ -5,9 +5,14 @@
 #include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "fenwick_tree.h"
 #include "packet.h"
 #include "tcp_sacks.h"
+#include "tcp_scoreboard.h"
 #include "tcp_timer.h"
+#include "tcp_tx_index.h"
+#include "util.h"
 
 class TcpEndpoint {
     public:
@@ -15,7 +20,9 @@ class TcpEndpoint {
         // considered to be trigger by the reception of packet A
         static const uint64_t kMaxTriggerPacketDelayUs;
 
-        explicit TcpEndpoint(Packet* packet);
+        // Creates the endpoint that sent the given packet. On-the-wire copies
+        // of its packets are allocated in the given arena
+        TcpEndpoint(Packet* packet, Arena* arena);
 
         inline uint32_t addr() const {
             return addr_;
@@ -23,10 +30,10 @@ class TcpEndpoint {
         inline uint16_t port() const {
             return port_;
         }
-        inline std::vector<Packet*> packets() const {
+        inline const std::vector<Packet*>& packets() const {
             return packets_;
         }
-        inline TcpTimer timer() const {
+        inline const TcpTimer& timer() const {
             return timer_;
         }
         inline uint32_t min_rtt_us() const {
@@ -35,6 +42,19 @@ class TcpEndpoint {
         inline bool is_bogus() const {
             return is_bogus_;
         }
+        // Returns the unwrapped sequence number for the given sequence number
+        // relative to the initial one
+        inline uint64_t GetUnwrappedSeq(uint32_t relative_seq) const {
+            return unwrapped_seq_init_ + relative_seq;
+        }
+        // Number of unacked packets that are not marked as lost
+        inline uint32_t num_in_flight() const {
+            return num_in_flight_;
+        }
+        // Number of unacked packets that are marked as lost
+        inline uint32_t num_unacked_lost() const {
+            return unacked_packets_.size() - num_in_flight_;
+        }
         uint32_t GetUnackedBytes() const {
             if (sacks_.num_bytes() > seq_next_ - seq_acked_) {
                 return 0;
@@ -43,6 +63,14 @@ class TcpEndpoint {
             }
         }
 
+        // Returns the number of unacked bytes when the given packet (of this
+        // endpoint) was transmitted, including corrections for SACKs that were
+        // only discovered later
+        inline uint32_t GetUnackedBytes(const Packet& packet) const {
+            return packet.tcp()->unacked_bytes() +
+                unacked_bytes_offsets_.Get(packet.position());
+        }
+
         // Initialize state relying on sequence numbers (once negotiated).
         // Relative sequence and ACK numbers start at 1.
         void SetInitialSequenceNumbers();
@@ -123,12 +151,25 @@ class TcpEndpoint {
         // lost)
         std::vector<std::pair<double, double>>
             GetUnackedBytesRttPairs() const;
-        
-        std::vector<std::pair<double, double>>
-            GetUnackedBytesRttPairsAroundPacket(
-                    const Packet& target_packet,
-                    uint8_t num_samples,
-                    bool use_older_packets_only) const;
+
+        // Returns TRUE if the packet's ACK delay is an RTT sample for the
+        // number of unacked bytes, i.e. it was transmitted in-order and was
+        // not lost
+        static bool IsUnackedBytesRttSample(const Packet& packet);
+
+        // Adds the <# unacked bytes, RTT> samples (see above) to the given
+        // accumulator
+        void AddUnackedBytesRttSamples(
+                stats_util::LinearFitAccumulator* samples) const;
+
+        // Adds the samples around the given packet (num_samples / 2 up to and
+        // including the packet, and as many from the packet on), or only the
+        // num_samples up to and including the packet
+        void AddUnackedBytesRttSamplesAroundPacket(
+                const Packet& target_packet,
+                uint8_t num_samples,
+                bool use_older_packets_only,
+                stats_util::LinearFitAccumulator* samples) const;
 
         // Helper methods to calculate the number of packets where the given
         // function returns a non-zero value (e.g. data length, has SACKs, ...)
@@ -185,6 +226,11 @@ class TcpEndpoint {
         // timers!
         void HandleAckedPacket(Packet* packet, Packet* ack);
 
+        // Updates the in-flight and loss counts after the loss state of the
+        // given packet might have changed (e.g. by linking a retransmission or
+        // by a DSACK)
+        void UpdateLossCounts(const Packet& packet, bool was_lost);
+
         // We determined that his packet was sacked, now we find the earliest
         // SACK lookalike that was (probably) responsible for this.
         // Returns TRUE, if we matched a SACK lookalike and sacked the packet
@@ -197,7 +243,7 @@ class TcpEndpoint {
         void CheckForSacksFromLookalikes();
 
         // For each data packet since the given packet add 'offset' to its
-        // unacked_bytes count
+        // unacked_bytes count (recorded in unacked_bytes_offsets_)
         void AdjustUnackedBytesCountsAfter(const Packet& packet, int32_t offset);
 
         // Look for the most recent packet that carried (at least) the same
@@ -212,6 +258,8 @@ class TcpEndpoint {
         const uint32_t addr_;
         const uint16_t port_;
 
+        Arena* arena_;
+
         // (Estimated) maximum segment size allowed for this endpoint to
         // transmit
         uint32_t mss_ = 0;
@@ -219,9 +267,21 @@ class TcpEndpoint {
         // All packets transmitted by this endpoint
         std::vector<Packet*> packets_;
 
+        // Corrections of the unacked_bytes counts of the packets above (by
+        // position), which are applied when reading the counts
+        FenwickTree unacked_bytes_offsets_;
+
+        // Sequence ranges carried by the packets above (to look up earlier
+        // transmissions of retransmitted sequences)
+        TcpTxIndex tx_index_;
+
         // Packets that have not been acknowledged yet (SACKed packets are
         // treated as acknowledged even though SACK reneging can happen)
-        std::vector<Packet*> unacked_packets_;
+        TcpScoreboard unacked_packets_;
+
+        // Packets acked by the ACK that is currently processed (kept to reuse
+        // the allocation)
+        std::vector<Packet*> acked_packets_;
 
         // If header options are truncated we may end up with dupacks which have
         // their SACK blocks cut off. Here we store the lookalikes that haven't
@@ -241,7 +301,7 @@ class TcpEndpoint {
 
         // Sequence ranges that have been SACKed (but not yet ACKed). This
         // possibly combines SACK blocks seen in multiple ACKs
-        TcpSacks sacks_;
+        MergedSacks sacks_;
 
         // Tracks RTT samples and computes the smoothed RTT required for timeout
         // computation
@@ -258,22 +318,29 @@ class TcpEndpoint {
         // the recovery period ends, and to recover the seq_next_ value in case
         // we wrongly inferred than an RTO happened (e.g. when discovering TLP
         // instead)
-        uint32_t rto_high_seq_ = 0;
+        uint64_t rto_high_seq_ = 0;
 
         // Number of data packets transmitted by this endpoint (i.e. packets
         // carrying a payload)
         uint32_t num_data_packets_ = 0;
 
-        // Number of data packets that are in flight (transmitted but not yet
+        // Number of packets that are in flight (transmitted but not yet
         // acked or marked as lost)
         uint32_t num_in_flight_ = 0;
+
+        // Number of packets that are marked as lost (including acked ones)
+        uint32_t num_losses_ = 0;
         
-        // Highest sequence acked
-        uint32_t seq_acked_ = 0;
+        // Highest sequence acked (unwrapped, like all 64-bit sequence numbers
+        // of the endpoint)
+        uint64_t seq_acked_ = 0;
 
         // Next in-order sequence to transmit (does not include possible
         // retransmissions)
-        uint32_t seq_next_ = 0;
+        uint64_t seq_next_ = 0;
+
+        // Unwrapped initial sequence number
+        uint64_t unwrapped_seq_init_ = 0;
 
         // Initial sequence number (i.e. negotiated during SYN exchange or the
         // first sequence number seen in case of partially captured connections)
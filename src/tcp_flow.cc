@@ -1,19 +1,28 @@
 #include "tcp_flow.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 #include "ip_packet.h"
 #include "tcp_endpoint.h"
 #include "tcp_packet.h"
+#include "util.h"
 
 TcpFlow::TcpFlow(const TcpFlowId& id)
         : id_(id), endpoint_a_(nullptr), endpoint_b_(nullptr) {}
 
-bool TcpFlow::AddPacket(std::unique_ptr<Packet> packet, bool process_packet) {
-    auto packet_ptr = packet.get();
-    owned_packets_.push_back(std::move(packet));
-    return AddPacketToEndpoint(packet_ptr, process_packet);
+bool TcpFlow::AddPacketCopy(const Packet& packet, uint32_t copy_len) {
+    Packet* packet_copy;
+    if (copy_len) {
+        packet_copy = arena_.Make<Packet>(
+                packet, arena_.Copy(packet.packet(), copy_len), copy_len);
+    } else {
+        packet_copy = arena_.Make<Packet>(packet);
+    }
+    packet_copy->set_index(packet.index());
+    owned_packets_.push_back(packet_copy);
+    return AddPacketToEndpoint(packet_copy, true);
 }
 
 bool TcpFlow::AddPacket(Packet* packet, bool process_packet) {
@@ -28,7 +37,7 @@ bool TcpFlow::AddPacketToEndpoint(Packet* packet, bool process_packet) {
     if (endpoint_a_ == nullptr) {
         // This is the first packet for this flow, therefore create the first
         // endpoint
-        endpoint_a_ = std::make_unique<TcpEndpoint>(packet);
+        endpoint_a_ = std::make_unique<TcpEndpoint>(packet, &arena_);
     }
     
     // Check if the packet carries the MSS option which we might have to buffer
@@ -46,7 +55,7 @@ bool TcpFlow::AddPacketToEndpoint(Packet* packet, bool process_packet) {
         // it does not exist yet. At this point we should also have extracted
         // the MSS value from the respective header option
         if (endpoint_b_ == nullptr) {
-            endpoint_b_ = std::make_unique<TcpEndpoint>(packet);
+            endpoint_b_ = std::make_unique<TcpEndpoint>(packet, &arena_);
             if (mss_a_) {
                 endpoint_a_->mss_ = mss_a_;
             }
@@ -59,6 +68,12 @@ bool TcpFlow::AddPacketToEndpoint(Packet* packet, bool process_packet) {
     }
     current_sender->AddPacket(packet, process_packet);
 
+    if (process_packet) {
+        CheckForClose(*packet, current_sender == endpoint_a());
+        last_timestamp_us_ =
+            std::max(last_timestamp_us_, packet->timestamp_us());
+    }
+
     // Process ACKs for the opposite endpoint
     if (process_packet && packet->tcp()->IsAck() && current_receiver != nullptr) {
         current_receiver->ProcessAck(packet);
@@ -94,6 +109,34 @@ void TcpFlow::CheckForMSS(const Packet& packet) {
     }
 }
 
+void TcpFlow::CheckForClose(const Packet& packet, bool from_endpoint_a) {
+    const TcpPacket& tcp = *(packet.tcp());
+    if (tcp.IsRst()) {
+        is_reset_ = true;
+        return;
+    }
+
+    // The FIN occupies one sequence number after the payload
+    if (tcp.IsFin()) {
+        if (from_endpoint_a) {
+            fin_seq_end_a_ = tcp.seq_end() + 1;
+            fin_sent_a_ = true;
+        } else {
+            fin_seq_end_b_ = tcp.seq_end() + 1;
+            fin_sent_b_ = true;
+        }
+    }
+    if (tcp.IsAck()) {
+        if (from_endpoint_a && fin_sent_b_ &&
+                !tcp_util::Before(tcp.ack(), fin_seq_end_b_)) {
+            fin_acked_b_ = true;
+        } else if (!from_endpoint_a && fin_sent_a_ &&
+                !tcp_util::Before(tcp.ack(), fin_seq_end_a_)) {
+            fin_acked_a_ = true;
+        }
+    }
+}
+
 std::vector<std::unique_ptr<TcpFlow>> TcpFlow::SplitIntoSegments() const {
     std::vector<std::unique_ptr<TcpFlow>> segments;
     
@@ -108,7 +151,7 @@ std::vector<std::unique_ptr<TcpFlow>> TcpFlow::SplitIntoSegments() const {
     for (auto& packet : owned_packets_) {
         // Non-data packets do not trigger a new segment
         if (!packet->tcp()->data_len()) {
-            current_segment->AddPacket(packet.get(), false);
+            current_segment->AddPacket(packet, false);
             continue;
         }
 
@@ -125,7 +168,7 @@ std::vector<std::unique_ptr<TcpFlow>> TcpFlow::SplitIntoSegments() const {
                 segments.push_back(std::unique_ptr<TcpFlow>(current_segment));
             }
         }
-        current_segment->AddPacket(packet.get(), false);
+        current_segment->AddPacket(packet, false);
     }
 
     return segments;
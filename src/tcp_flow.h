@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "packet.h"
 #include "tcp_endpoint.h"
 
@@ -35,6 +36,29 @@ typedef struct TcpFlowId {
         return src_addr < id.src_addr;
     }
 
+    // Returns the direction-independent version of this ID, i.e. the endpoint
+    // with the lower address (and port) comes first
+    TcpFlowId Canonical() const {
+        if (src_addr < dst_addr ||
+                (src_addr == dst_addr && src_port <= dst_port)) {
+            return *this;
+        }
+        return {dst_addr, src_addr, dst_port, src_port};
+    }
+
+    // Mixes all bits of the 4-tuple (finalizer of MurmurHash3)
+    uint64_t Hash() const {
+        uint64_t hash = (static_cast<uint64_t>(src_addr) << 32) | dst_addr;
+        hash ^= ((static_cast<uint64_t>(src_port) << 16) | dst_port) *
+            0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
     std::string str() const {
         std::ostringstream buffer;
         buffer << src_addr << ":" << src_port << " -> "
@@ -47,11 +71,14 @@ class TcpFlow {
     public:
         explicit TcpFlow(const TcpFlowId& id);
 
+        // Stores a copy of the given packet in this flow's arena and processes
+        // it. If copy_len is not 0, the first copy_len captured bytes are
+        // copied as well and the copy only wraps these (e.g. if the bytes are
+        // only valid during a libpcap callback or to drop the payload)
         // Returns TRUE, unless there is an indication that the sending endpoint
         // saw bogus data
-        bool AddPacket(std::unique_ptr<Packet> packet,
-                bool process_packet);
-        
+        bool AddPacketCopy(const Packet& packet, uint32_t copy_len);
+
         bool AddPacket(Packet* packet, bool process_packet);
 
         bool AddPacketToEndpoint(Packet* packet, bool process_packet);
@@ -59,6 +86,15 @@ class TcpFlow {
         inline const TcpFlowId id() const {
             return id_;
         }
+        inline uint32_t index() const {
+            return index_;
+        }
+        inline uint64_t last_timestamp_us() const {
+            return last_timestamp_us_;
+        }
+        inline void set_index(const uint32_t index) {
+            index_ = index;
+        }
         inline TcpEndpoint* endpoint_a() const {
             return endpoint_a_.get();
         }
@@ -68,12 +104,28 @@ class TcpFlow {
 
         std::vector<std::unique_ptr<TcpFlow>> SplitIntoSegments() const;
 
+        // Returns TRUE, if the connection was reset or both endpoints sent a
+        // FIN that was acknowledged by the other endpoint
+        inline bool IsClosed() const {
+            return is_reset_ || (fin_acked_a_ && fin_acked_b_);
+        }
+
     private:
         // Extract and buffer the maximum segment size (MSS) value if possible
         void CheckForMSS(const Packet& packet);
 
+        // Track FINs, their ACKs and resets to tell when the connection is
+        // closed
+        void CheckForClose(const Packet& packet, bool from_endpoint_a);
+
+        // Packets (and their on-the-wire copies) of this flow. Declared first
+        // so that it is released after everything referencing the packets
+        Arena arena_;
+
         std::vector<Packet*> packets_;
-        std::vector<std::unique_ptr<Packet>> owned_packets_;
+
+        // Packets allocated in this flow's arena
+        std::vector<Packet*> owned_packets_;
 
         const TcpFlowId id_;
         std::unique_ptr<TcpEndpoint> endpoint_a_;
@@ -84,6 +136,22 @@ class TcpFlow {
         // from endpoint B and vice versa
         uint32_t mss_a_ = 0;
         uint32_t mss_b_ = 0;
+
+        // Order in which this flow was first seen in its capture
+        uint32_t index_ = 0;
+
+        // Latest timestamp of all packets processed so far
+        uint64_t last_timestamp_us_ = 0;
+
+        // Sequence number following the FIN sent by endpoint A (B). Only valid
+        // if fin_sent_a_ (fin_sent_b_) is set
+        uint32_t fin_seq_end_a_ = 0;
+        uint32_t fin_seq_end_b_ = 0;
+        bool fin_sent_a_ = false;
+        bool fin_sent_b_ = false;
+        bool fin_acked_a_ = false;
+        bool fin_acked_b_ = false;
+        bool is_reset_ = false;
 };
 
 #endif  /* TCP_FLOW_H_ */
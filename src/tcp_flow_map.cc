@@ -1,90 +1,391 @@
 #include "tcp_flow_map.h"
 
+#include <algorithm>
+#include <glog/logging.h>
 #include <iostream>
 
 #include "ethernet_packet.h"
 #include "ip_packet.h"
 #include "packet.h"
+#include "packet_filter.h"
+#include "reorder_buffer.h"
+#include "sharded_flow_map.h"
 #include "tcp_packet.h"
 
-// Datalink type of the packets captured in the tcpdump. The type
-// determines if and how the Ethernet header is parsed
-int pcap_datalink_type_;
+constexpr uint64_t TcpFlowMap::kClosedFlowLingerUs = 1000000;
+constexpr uint64_t TcpFlowMap::kSweepIntervalUs = 1000000;
 
-bool TcpFlowMap::AddPacket(std::unique_ptr<Packet> packet) {
+// Initial number of slots of the flow table
+constexpr size_t kInitialTableSize = 16;
+
+TcpFlowMap::TcpFlowMap(bool headers_only) : headers_only_(headers_only) {}
+
+bool TcpFlowMap::AddPacket(Packet* packet, bool copy_bytes) {
     packet->set_index(index_++);
+    return AddIndexedPacket(*packet, copy_bytes);
+}
 
-    TcpFlowId flow_id = {
-        packet->ip()->src_addr(),
-        packet->ip()->dst_addr(),
-        packet->tcp()->src_port(),
-        packet->tcp()->dst_port()
-    };
-    TcpFlowId rev_flow_id = {
-        packet->ip()->dst_addr(),
-        packet->ip()->src_addr(),
-        packet->tcp()->dst_port(),
-        packet->tcp()->src_port()
+bool TcpFlowMap::AddIndexedPacket(const Packet& packet, bool copy_bytes) {
+    const TcpFlowId flow_id = {
+        packet.ip()->src_addr(),
+        packet.ip()->dst_addr(),
+        packet.tcp()->src_port(),
+        packet.tcp()->dst_port()
     };
+    TcpFlow* flow = FindOrAddFlow(flow_id);
+
+    uint32_t copy_len = 0;
+    if (headers_only_) {
+        copy_len = packet.headers_caplen();
+    } else if (copy_bytes) {
+        copy_len = packet.caplen();
+    }
+    const bool is_valid = flow->AddPacketCopy(packet, copy_len);
+
+    if (finalize_callback_ && packet.timestamp_us() >= next_sweep_us_) {
+        FinalizeInactiveFlows(packet.timestamp_us());
+        next_sweep_us_ = packet.timestamp_us() + kSweepIntervalUs;
+    }
+
+    return is_valid;
+}
+
+std::vector<const TcpFlow*> TcpFlowMap::GetFlows() const {
+    std::vector<const TcpFlow*> flows;
+    flows.reserve(flows_.size());
+    for (const auto& flow : flows_) {
+        flows.push_back(flow.get());
+    }
+    std::sort(flows.begin(), flows.end(),
+            [](const TcpFlow* a, const TcpFlow* b) {
+        return a->id() < b->id();
+    });
+    return flows;
+}
 
-    auto iter = map_.find(flow_id);
-    if (iter == map_.end()) {
-        iter = map_.find(rev_flow_id);
-        if (iter == map_.end()) {
-            map_[flow_id] = std::make_unique<TcpFlow>(flow_id);
+TcpFlow* TcpFlowMap::FindOrAddFlow(const TcpFlowId& flow_id) {
+    if (table_.empty()) {
+        table_.resize(kInitialTableSize, {{0, 0, 0, 0}, nullptr});
+    }
+
+    const TcpFlowId key = flow_id.Canonical();
+    size_t slot = FindSlot(key);
+    if (table_[slot].flow_ != nullptr) {
+        return table_[slot].flow_;
+    }
+
+    // The flow is keyed by the direction of its first packet
+    if (2 * (flows_.size() + 1) > table_.size()) {
+        GrowTable();
+        slot = FindSlot(key);
+    }
+    flows_.push_back(std::make_unique<TcpFlow>(flow_id));
+    flows_.back()->set_index(flow_index_++);
+    table_[slot] = {key, flows_.back().get()};
+    return flows_.back().get();
+}
+
+size_t TcpFlowMap::FindSlot(const TcpFlowId& key) const {
+    const size_t mask = table_.size() - 1;
+    size_t slot = key.Hash() & mask;
+    while (table_[slot].flow_ != nullptr && !(table_[slot].key_ == key)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void TcpFlowMap::GrowTable() {
+    std::vector<Slot> old_table(table_.size() * 2, {{0, 0, 0, 0}, nullptr});
+    old_table.swap(table_);
+    for (const Slot& old_slot : old_table) {
+        if (old_slot.flow_ != nullptr) {
+            table_[FindSlot(old_slot.key_)] = old_slot;
+        }
+    }
+}
+
+void TcpFlowMap::RemoveFromTable(const TcpFlowId& flow_id) {
+    const size_t mask = table_.size() - 1;
+    size_t slot = FindSlot(flow_id.Canonical());
+    table_[slot].flow_ = nullptr;
+
+    // Move following entries of the probe sequence into the gap (if their
+    // home slot allows it), so that lookups don't stop early at the gap
+    size_t next = (slot + 1) & mask;
+    while (table_[next].flow_ != nullptr) {
+        const size_t home = table_[next].key_.Hash() & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            table_[slot] = table_[next];
+            table_[next].flow_ = nullptr;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+void TcpFlowMap::EnableStreaming(const FlowCallback& callback,
+        uint64_t idle_timeout_us) {
+    finalize_callback_ = callback;
+    idle_timeout_us_ = idle_timeout_us;
+}
+
+void TcpFlowMap::FinalizeInactiveFlows(uint64_t now_us) {
+    // Flows that are not finalized keep their order of creation
+    size_t num_kept = 0;
+    for (size_t i = 0; i < flows_.size(); i++) {
+        const TcpFlow& flow = *flows_[i];
+        const uint64_t idle_us = now_us > flow.last_timestamp_us() ?
+            now_us - flow.last_timestamp_us() : 0;
+        if (idle_us >= idle_timeout_us_ ||
+                (flow.IsClosed() && idle_us >= kClosedFlowLingerUs)) {
+            RemoveFromTable(flow.id());
+            finalize_callback_(flow);
+            flows_[i].reset();
         } else {
-            flow_id = rev_flow_id;
+            flows_[num_kept++] = std::move(flows_[i]);
         }
     }
+    flows_.resize(num_kept);
+}
 
-    return map_[flow_id]->AddPacket(std::move(packet), true);
+void TcpFlowMap::FinalizeAllFlows() {
+    for (const auto& flow : flows_) {
+        finalize_callback_(*flow);
+    }
+    flows_.clear();
+    table_.clear();
 }
 
+TcpFlowMapFactory::TcpFlowMapFactory(bool headers_only,
+        size_t reorder_window, const std::string& filter)
+        : headers_only_(headers_only),
+          reorder_window_(reorder_window),
+          filter_(filter) {}
+
 std::unique_ptr<TcpFlowMap> TcpFlowMapFactory::MakeFromPcap(
         const char* filename) {
+    auto map = std::make_unique<TcpFlowMap>(headers_only_);
+    if (!ReadPcap(filename, map.get())) {
+        return nullptr;
+    }
+    return map;
+}
+
+std::unique_ptr<TcpFlowMap> TcpFlowMapFactory::MakeFromPcap(
+        std::unique_ptr<MappedPcap> mapped_pcap) {
+    auto map = std::make_unique<TcpFlowMap>(headers_only_);
+    if (!ReadMappedPcap(std::move(mapped_pcap), map.get())) {
+        return nullptr;
+    }
+    return map;
+}
+
+bool TcpFlowMapFactory::StreamFromPcap(const char* filename,
+        const TcpFlowMap::FlowCallback& callback, uint64_t idle_timeout_us) {
+    TcpFlowMap map(headers_only_);
+    map.EnableStreaming(callback, idle_timeout_us);
+    if (!ReadPcap(filename, &map)) {
+        return false;
+    }
+    map.FinalizeAllFlows();
+    return true;
+}
+
+bool TcpFlowMapFactory::StreamFromPcap(
+        std::unique_ptr<MappedPcap> mapped_pcap,
+        const TcpFlowMap::FlowCallback& callback, uint64_t idle_timeout_us) {
+    TcpFlowMap map(headers_only_);
+    map.EnableStreaming(callback, idle_timeout_us);
+    if (!ReadMappedPcap(std::move(mapped_pcap), &map)) {
+        return false;
+    }
+    map.FinalizeAllFlows();
+    return true;
+}
+
+std::unique_ptr<ShardedFlowMap> TcpFlowMapFactory::MakeShardedFromPcap(
+        const char* filename, size_t num_shards) {
+    auto map = std::make_unique<ShardedFlowMap>(num_shards, headers_only_);
+    const bool is_valid = ReadPcap(filename, map.get());
+    // Wait for the shards in any case, they may still use the read packets
+    if (!map->Finish() || !is_valid) {
+        return nullptr;
+    }
+    return map;
+}
+
+std::unique_ptr<ShardedFlowMap> TcpFlowMapFactory::MakeShardedFromPcap(
+        std::unique_ptr<MappedPcap> mapped_pcap, size_t num_shards) {
+    auto map = std::make_unique<ShardedFlowMap>(num_shards, headers_only_);
+    const bool is_valid = ReadMappedPcap(std::move(mapped_pcap), map.get());
+    // Wait for the shards in any case, they may still use the read packets
+    if (!map->Finish() || !is_valid) {
+        return nullptr;
+    }
+    return map;
+}
+
+template<typename FlowMap>
+bool TcpFlowMapFactory::ReadPcap(const char* filename, FlowMap* map) {
+    auto mapped_pcap = MappedPcap::Open(filename);
+    if (mapped_pcap != nullptr) {
+        return ReadMappedPcap(std::move(mapped_pcap), map);
+    }
+
     char errbuf[PCAP_ERRBUF_SIZE];
 
     pcap_t* pcap_handle = pcap_open_offline(filename, errbuf);
     if (pcap_handle == NULL) {
         std::cerr << "pcap_open_offline() failed: "
                   << errbuf << std::endl;
-        return nullptr;
+        return false;
     }
 
-    // Get the datalink type (determines if and how the Ethernet header is
-    // extracted)
-    pcap_datalink_type_ = pcap_datalink(pcap_handle);
+    std::unique_ptr<PacketFilter> filter;
+    if (!CompileFilter(pcap_datalink(pcap_handle), &filter)) {
+        pcap_close(pcap_handle);
+        return false;
+    }
+
+    // Packets are reordered before they are added to the map
+    ReorderBuffer reorder_buffer(reorder_window_, headers_only_,
+            [map](Packet* packet, bool copy_bytes) {
+        return map->AddPacket(packet, copy_bytes);
+    });
 
-    // Define function that processes each packet, i.e. adds it to the flow
-    // map if it is a TCP packet
-    auto process_packet_function =
-        [](u_char* process_args, const struct pcap_pkthdr* pkthdr,
-                const u_char* packet) {
-        auto parsed_packet = std::make_unique<Packet>(packet, pkthdr);
-        if (parsed_packet->is_tcp() &&
-                !parsed_packet->tcp()->is_bogus()) {
+    // The datalink type determines if and how the link header is parsed.
+    // Packets are read by a function specialized for the type
+    auto read_packets = [pcap_handle, &filter, &reorder_buffer](
+            auto link_type) {
+        // Define function that processes each packet, i.e. adds it to the
+        // flow map if it is a TCP packet
+        auto process_packet_function =
+            [](u_char* process_args, const struct pcap_pkthdr* pkthdr,
+                    const u_char* packet) {
             auto process_args_array = reinterpret_cast<void**>(process_args);
-            auto pcap_handle = reinterpret_cast<pcap_t*>(process_args_array[0]);
-            auto flow_map = reinterpret_cast<TcpFlowMap*>(process_args_array[1]);
-            if (!flow_map->AddPacket(std::move(parsed_packet))) {
-                pcap_breakloop(pcap_handle);
+            auto filter =
+                reinterpret_cast<const PacketFilter*>(process_args_array[1]);
+            if (filter != nullptr && !filter->Matches(pkthdr, packet)) {
+                return;
+            }
+
+            // The bytes are only read here, the flow stores a copy of them
+            Packet parsed_packet(const_cast<u_char*>(packet), pkthdr,
+                    decltype(link_type)());
+            if (parsed_packet.is_tcp() &&
+                    !parsed_packet.tcp()->is_bogus()) {
+                auto pcap_handle = reinterpret_cast<pcap_t*>(process_args_array[0]);
+                auto reorder_buffer =
+                    reinterpret_cast<ReorderBuffer*>(process_args_array[2]);
+                if (!reorder_buffer->Add(&parsed_packet, true)) {
+                    pcap_breakloop(pcap_handle);
+                }
+            }
+        };
+
+        // Iterate through the PCAP and call the processing function for
+        // each packet. Currently the function gets three arguments:
+        // 1. the PCAP handle to break the loop if necessary
+        // 2. the capture filter (if any) to skip packets before parsing them
+        // 3. the reorder buffer to add the new packet to it
+        void* process_args[3] = { pcap_handle, filter.get(), &reorder_buffer };
+        if (pcap_loop(pcap_handle, 0, process_packet_function,
+                    reinterpret_cast<u_char*>(process_args)) < 0) {
+            std::cerr << "pcap_loop() failed: "
+                      << pcap_geterr(pcap_handle) << std::endl;
+            return false;
+        }
+        return true;
+    };
+    const bool is_valid = DispatchLinkType(pcap_datalink(pcap_handle),
+            read_packets);
+    pcap_close(pcap_handle);
+
+    return is_valid && FlushReorderBuffer(&reorder_buffer);
+}
+
+template<typename FlowMap>
+bool TcpFlowMapFactory::ReadMappedPcap(
+        std::unique_ptr<MappedPcap> mapped_pcap, FlowMap* map) {
+    // Packets wrap the mapped bytes, so the map keeps the mapping alive (even
+    // if we stop early, packets may still be in use by a sharded map)
+    MappedPcap* mapped = mapped_pcap.get();
+    map->mapped_pcap_ = std::move(mapped_pcap);
+
+    std::unique_ptr<PacketFilter> filter;
+    if (!CompileFilter(mapped->datalink_type(), &filter)) {
+        return false;
+    }
+
+    // Packets are reordered before they are added to the map
+    ReorderBuffer reorder_buffer(reorder_window_, headers_only_,
+            [map](Packet* packet, bool copy_bytes) {
+        return map->AddPacket(packet, copy_bytes);
+    });
+
+    // The datalink type determines if and how the link header is parsed.
+    // Packets are read by a loop specialized for the type
+    auto read_packets = [this, mapped, &filter, &reorder_buffer](
+            auto link_type) {
+        struct pcap_pkthdr pcap_header;
+        u_char* packet;
+        while (mapped->Next(&pcap_header, &packet)) {
+            // Records that do not match the filter are skipped before parsing
+            if (filter == nullptr || filter->Matches(&pcap_header, packet)) {
+                Packet parsed_packet(packet, &pcap_header, link_type);
+                if (parsed_packet.is_tcp() &&
+                        !parsed_packet.tcp()->is_bogus() &&
+                        !reorder_buffer.Add(&parsed_packet, false)) {
+                    std::cerr << "Stopped processing due to bogus data"
+                              << std::endl;
+                    return false;
+                }
+            }
+
+            // If we only keep the headers, these were copied (also by the
+            // reorder buffer) and we can drop the pages we are done with
+            if (headers_only_) {
+                mapped->ReleaseConsumed();
             }
         }
+        return true;
     };
+    if (!DispatchLinkType(mapped->datalink_type(), read_packets) ||
+            !FlushReorderBuffer(&reorder_buffer)) {
+        return false;
+    }
+    if (mapped->is_truncated()) {
+        std::cerr << "Truncated capture file" << std::endl;
+        return false;
+    }
+    if (headers_only_) {
+        map->mapped_pcap_.reset();
+    }
 
-    // Iterate through the PCAP and call the processing function for
-    // each packet. Currently the function gets two arguments:
-    // 1. the PCAP handle to break the loop if necessary
-    // 2. the flow map to add the new packet to it
-    auto map = std::make_unique<TcpFlowMap>();
-    void* process_args[2] = { pcap_handle, map.get() };
-    if (pcap_loop(pcap_handle, 0, process_packet_function,
-                reinterpret_cast<u_char*>(process_args)) < 0) {
-        std::cerr << "pcap_loop() failed: "
-                  << pcap_geterr(pcap_handle) << std::endl;
-        return nullptr;
+    return true;
+}
+
+bool TcpFlowMapFactory::CompileFilter(int datalink_type,
+        std::unique_ptr<PacketFilter>* filter) {
+    if (filter_.empty()) {
+        return true;
     }
-    pcap_close(pcap_handle);
+    *filter = PacketFilter::Compile(filter_, datalink_type);
+    return *filter != nullptr;
+}
 
-    return map;
+bool TcpFlowMapFactory::FlushReorderBuffer(ReorderBuffer* reorder_buffer) {
+    if (!reorder_buffer->Flush()) {
+        std::cerr << "Stopped processing due to bogus data" << std::endl;
+        return false;
+    }
+
+    VLOG(1) << "Reordered " << reorder_buffer->num_reordered() << " packets";
+    if (reorder_buffer->is_overflowed()) {
+        LOG(WARNING) << "Reorder window of " << reorder_window_
+                     << " packets overflowed, sorted the rest of the capture ("
+                     << reorder_buffer->num_late()
+                     << " packets remain out of order)";
+    }
+    return true;
 }
@@ -1,43 +1,204 @@
 #ifndef TCP_FLOW_MAP_H_
 #define TCP_FLOW_MAP_H_
 
-#include <map>
+#include <functional>
 #include <memory>
 #include <netinet/ip.h>
 #include <pcap.h>
+#include <string>
+#include <vector>
 
+#include "mapped_pcap.h"
 #include "packet.h"
 #include "tcp_flow.h"
 
+class PacketFilter;
+class ReorderBuffer;
+class ShardedFlowMap;
+
 class TcpFlowMap {
     public:
+        // In streaming mode, a closed flow is finalized once it did not see any
+        // packets for this long (to still catch stray packets after closing)
+        static const uint64_t kClosedFlowLingerUs;
+
+        // In streaming mode, flows are checked for finalization whenever the
+        // trace time advanced by this interval
+        static const uint64_t kSweepIntervalUs;
+
+        // Function that is handed each flow finalized in streaming mode. The
+        // flow is destroyed once the function returns
+        typedef std::function<void(const TcpFlow& flow)> FlowCallback;
+
+        // If headers_only is TRUE, packets only keep their header bytes (the
+        // analysis never reads the payload)
+        explicit TcpFlowMap(bool headers_only = false);
+
         // Adds a new packet to the matching flow in this flow map. If no
         // matching flow exists yet, a new one is created. Mapping is
         // based on TcpFlowId and does NOT handle potentially separate
         // flows with the same TcpFlowId (e.g. a reused TCP connection)
+        // The flow stores a copy of the packet, including its captured bytes if
+        // copy_bytes is TRUE (only the header bytes if the map keeps headers
+        // only).
         // Returns TRUE, unless there is an indication that the sending endpoint
         // deals with bogus data
-        bool AddPacket(std::unique_ptr<Packet> packet);
+        bool AddPacket(Packet* packet, bool copy_bytes);
+
+        // Same as AddPacket(), but keeps the index of the given packet (e.g.
+        // assigned by a reader that distributes packets across several maps)
+        bool AddIndexedPacket(const Packet& packet, bool copy_bytes);
 
-        const std::map<TcpFlowId, std::unique_ptr<TcpFlow>>& map() const {
-            return map_;
+        inline size_t num_flows() const {
+            return flows_.size();
         }
 
+        // Returns all flows ordered by their TcpFlowId (i.e. the 4-tuple of the
+        // first packet of each flow). This gives a deterministic flow index
+        // that does not depend on the layout of the hash table
+        std::vector<const TcpFlow*> GetFlows() const;
+
+        // Enables streaming, i.e. flows are finalized as soon as they are done
+        // instead of being kept until the end of the capture. A flow is done
+        // once it is closed (see TcpFlow::IsClosed()) and lingered for
+        // kClosedFlowLingerUs, or once it did not see any packets for
+        // idle_timeout_us. Finalized flows are handed to the callback and
+        // removed from this map, so memory use is bounded by the number of
+        // concurrently active flows
+        void EnableStreaming(const FlowCallback& callback,
+                uint64_t idle_timeout_us);
+
+        // Finalizes all flows left in streaming mode (in order of creation)
+        void FinalizeAllFlows();
+
     private:
-        std::map<TcpFlowId, std::unique_ptr<TcpFlow>> map_;
+        // Slot of the flow table. Empty slots don't point to a flow
+        typedef struct {
+            TcpFlowId key_;
+            TcpFlow* flow_;
+        } Slot;
+
+        // Returns the flow with the given TcpFlowId (in either direction),
+        // creating it if it does not exist yet
+        TcpFlow* FindOrAddFlow(const TcpFlowId& flow_id);
+
+        // Returns the index of the slot that holds the given (canonical) key or
+        // the empty slot where the key should be inserted
+        size_t FindSlot(const TcpFlowId& key) const;
+
+        // Doubles the size of the flow table
+        void GrowTable();
+
+        // Removes the flow with the given ID from the flow table
+        void RemoveFromTable(const TcpFlowId& flow_id);
+
+        // Finalizes all flows that are done at the given (trace) time
+        void FinalizeInactiveFlows(uint64_t now_us);
+
+        // Memory-mapped capture the packets in this map point into (if any).
+        // Declared before the flows so that it is unmapped after them
+        std::unique_ptr<MappedPcap> mapped_pcap_;
+
+        // Flows in the order of their creation
+        std::vector<std::unique_ptr<TcpFlow>> flows_;
+
+        // Open-addressing (linear probing) hash table of all flows. Flows are
+        // keyed on their canonical TcpFlowId, so that packets of both
+        // directions find their flow with a single probe sequence. The table
+        // size is a power of two and kept at most half full
+        std::vector<Slot> table_;
+
+        // TRUE, if packets only keep their header bytes
+        const bool headers_only_;
 
         // Running index for packets added to the map
         uint32_t index_ = 0;
+
+        // Running index for flows added to the map
+        uint32_t flow_index_ = 0;
+
+        // Streaming mode state (see EnableStreaming()). The callback is empty
+        // unless streaming is enabled
+        FlowCallback finalize_callback_;
+        uint64_t idle_timeout_us_ = 0;
+        uint64_t next_sweep_us_ = 0;
+
+        friend class TcpFlowMapFactory;
 };
 
 class TcpFlowMapFactory {
     public:
+        // If headers_only is TRUE, the created maps drop the payload bytes of
+        // all packets at ingest and only keep the link, IP and TCP headers
+        // (including options). Memory use then scales with the number of
+        // packets instead of the size of the capture.
+        // Packets are restored to timestamp order with a window of
+        // reorder_window packets before they are added (see ReorderBuffer).
+        // If the window is 0, packets are added in capture order.
+        // If filter is not empty, only packets matching this capture filter
+        // expression (e.g. "tcp port 3010") are parsed and added
+        explicit TcpFlowMapFactory(bool headers_only = false,
+                size_t reorder_window = 0, const std::string& filter = "");
+
         // Creates and populates a new TcpFlowMap based on packets parsed from a
-        // PCAP file
+        // PCAP file. Classic PCAP files are memory-mapped and parsed without
+        // copying packets, other formats (e.g. pcapng) are read via libpcap
         std::unique_ptr<TcpFlowMap> MakeFromPcap(const char* filename);
 
+        // Same as above, but reads a capture that is already in memory (e.g.
+        // loaded from an archive)
+        std::unique_ptr<TcpFlowMap> MakeFromPcap(
+                std::unique_ptr<MappedPcap> mapped_pcap);
+
+        // Streams the packets of a PCAP file through a TcpFlowMap in streaming
+        // mode (see TcpFlowMap::EnableStreaming()), i.e. each flow is handed to
+        // the callback once it is done and released afterwards.
+        // Returns FALSE, if the file could not be processed completely (flows
+        // handed to the callback up to that point are not affected)
+        bool StreamFromPcap(const char* filename,
+                const TcpFlowMap::FlowCallback& callback,
+                uint64_t idle_timeout_us);
+        bool StreamFromPcap(std::unique_ptr<MappedPcap> mapped_pcap,
+                const TcpFlowMap::FlowCallback& callback,
+                uint64_t idle_timeout_us);
+
+        // Same as MakeFromPcap(), but packets are handed from the reading
+        // thread to num_shards worker threads, each of which builds the flows
+        // of a disjoint set of 4-tuples (see ShardedFlowMap)
+        std::unique_ptr<ShardedFlowMap> MakeShardedFromPcap(
+                const char* filename, size_t num_shards);
+        std::unique_ptr<ShardedFlowMap> MakeShardedFromPcap(
+                std::unique_ptr<MappedPcap> mapped_pcap, size_t num_shards);
+
     private:
+        // Adds all packets of the given PCAP file to the map (a TcpFlowMap or
+        // a ShardedFlowMap). Returns FALSE if the file could not be read or
+        // contains bogus data
+        template<typename FlowMap>
+        bool ReadPcap(const char* filename, FlowMap* map);
+
+        // Adds packets that wrap the bytes of the given memory-mapped PCAP file
+        // to the map. The map takes over the mapping
+        template<typename FlowMap>
+        bool ReadMappedPcap(std::unique_ptr<MappedPcap> mapped_pcap,
+                FlowMap* map);
+
+        // Compiles the capture filter for the given datalink type (leaves the
+        // filter empty if there is none). Returns FALSE if the filter is
+        // invalid
+        bool CompileFilter(int datalink_type,
+                std::unique_ptr<PacketFilter>* filter);
+
+        // Releases the packets left in the reorder buffer and reports how many
+        // packets were reordered. Returns FALSE if the capture contains bogus
+        // data
+        bool FlushReorderBuffer(ReorderBuffer* reorder_buffer);
+
         pcap_t* pcap_handle_ = nullptr;
+
+        const bool headers_only_;
+        const size_t reorder_window_;
+        const std::string filter_;
 };
 
 #endif  /* TCP_FLOW_MAP_H_ */
@@ -5,17 +5,28 @@
 
 #include "util.h"
 
+TcpPacket::TcpPacket()
+        : len_(0),
+          caplen_(0) {}
+
 TcpPacket::TcpPacket(u_char* packet, const uint32_t len, const uint32_t caplen)
-        : packet_(packet),
-          len_(len),
-          caplen_(caplen),
-          header_(nullptr) {
+        : len_(len),
+          caplen_(caplen) {
     const size_t header_len = sizeof(struct tcphdr);
     if (caplen < header_len) {
+        // Without the fixed header we don't even know the ports
+        is_bogus_ = true;
         return;
     }
 
-    header_ = (struct tcphdr*) packet;
+    const struct tcphdr* header = (struct tcphdr*) packet;
+    seq_ = ntohl(header->th_seq);
+    ack_ = ntohl(header->th_ack);
+    src_port_ = ntohs(header->th_sport);
+    dst_port_ = ntohs(header->th_dport);
+    flags_ = header->th_flags;
+    data_offset_ = header->th_off << 2;
+    data_len_ = len_ - data_offset_;
 
     // Check for bogus packets
     is_bogus_ = CheckBogus(packet);
@@ -164,6 +175,7 @@ void TcpPacket::Cut(const uint32_t offset, const uint32_t data_len) {
     const size_t header_len = sizeof(struct tcphdr);
     const size_t opt_len = data_offset() - header_len;
     len_ = header_len + opt_len + data_len;
+    data_len_ = data_len;
 
     // Fix the captured length based on the removed payload parts
     if (caplen_ > header_len + opt_len + offset) {
@@ -173,11 +185,11 @@ void TcpPacket::Cut(const uint32_t offset, const uint32_t data_len) {
     }
 
     // Update sequence number
-    header_->th_seq = htonl(ntohl(header_->th_seq) + offset);
+    seq_ += offset;
 }
 
 bool TcpPacket::IsSacked(const TcpSacks& sacks) const {
-    for (const Sack sack : sacks.sacks()) {
+    for (const Sack& sack : sacks.sacks()) {
         if (tcp_util::RangeIncluded(
                     seq(), seq_end(), sack.start_, sack.end_)) {
             return true;
@@ -19,31 +19,33 @@ class Packet;
 
 class TcpPacket {
     public:
+        TcpPacket();
         TcpPacket(u_char* packet, const uint32_t len, const uint32_t caplen);
 
-        inline const u_char* packet() const {
-            return packet_;
-        }
         inline const uint16_t src_port() const {
-            return ntohs(header_->th_sport);
+            return src_port_;
         }
         inline const uint16_t dst_port() const {
-            return ntohs(header_->th_dport);
+            return dst_port_;
         }
         inline const uint32_t data_offset() const {
-            return header_->th_off << 2;
+            return data_offset_;
         }
         inline const uint32_t data_len() const {
-            return len_ - data_offset();
+            return data_len_;
+        }
+        // Number of payload bytes that were captured
+        inline const uint32_t captured_data_len() const {
+            return caplen_ > data_offset_ ? caplen_ - data_offset_ : 0;
         }
         inline const uint32_t seq() const {
-            return ntohl(header_->th_seq);
+            return seq_;
         }
         inline const uint32_t seq_end() const {
-            return seq() + data_len();
+            return seq_ + data_len_;
         }
         inline const uint32_t ack() const {
-            return ntohl(header_->th_ack);
+            return ack_;
         }
         inline const uint32_t relative_seq() const {
             return relative_seq_;
@@ -51,8 +53,17 @@ class TcpPacket {
         inline const uint32_t relative_ack() const {
             return relative_ack_;
         }
+        inline const uint64_t unwrapped_seq() const {
+            return unwrapped_seq_;
+        }
+        inline const uint64_t unwrapped_seq_end() const {
+            return unwrapped_seq_ + data_len_;
+        }
+        inline const uint64_t unwrapped_ack() const {
+            return unwrapped_ack_;
+        }
         inline const uint8_t flags() const {
-            return header_->th_flags;
+            return flags_;
         }
         inline const Packet* ack_packet() const {
             return ack_packet_;
@@ -60,7 +71,7 @@ class TcpPacket {
         inline const Packet* last_ack() const {
             return last_ack_;
         }
-        inline TcpSacks sacks() const {
+        inline const TcpSacks& sacks() const {
             return sacks_;
         }
         inline bool has_sack() const {
@@ -120,10 +131,10 @@ class TcpPacket {
         inline uint16_t num_rtx_attempts() const {
             return num_rtx_attempts_;
         }
-        inline TcpTimerInfo rto_info() const {
+        inline const TcpTimerInfo& rto_info() const {
             return rto_info_;
         }
-        inline TcpTimerInfo tlp_info() const {
+        inline const TcpTimerInfo& tlp_info() const {
             return tlp_info_;
         }
         inline uint32_t rto_estimate_us() const {
@@ -144,6 +155,9 @@ class TcpPacket {
         inline bool IsSyn() const {
             return flags() & TH_SYN;
         }
+        inline bool IsRst() const {
+            return flags() & TH_RST;
+        }
 
         inline bool RequiresAck() const {
             // The FIN requires an ACK as well but is not important for flow
@@ -177,14 +191,28 @@ class TcpPacket {
         // MSS) if we captured the full options block
         void ParseOptions(const u_char* packet);
 
-        const u_char* packet_;
-        size_t len_;
-        size_t caplen_;
-
-        struct tcphdr* header_;
-        
+        // Header fields in host byte order (decoded once while parsing). These
+        // are read by most of the analysis, so they are kept together at the
+        // start of the packet
+        uint32_t seq_ = 0;
+        uint32_t ack_ = 0;
         uint32_t relative_seq_ = 0;
         uint32_t relative_ack_ = 0;
+        uint32_t data_len_ = 0;
+        uint16_t src_port_ = 0;
+        uint16_t dst_port_ = 0;
+        uint8_t flags_ = 0;
+        uint8_t data_offset_ = 0;
+
+        // Sequence number unwrapped by the transmitting endpoint and ACK
+        // number unwrapped by the acked endpoint (see TcpEndpoint), s.t. they
+        // can be compared without taking wraparound into account
+        uint64_t unwrapped_seq_ = 0;
+        uint64_t unwrapped_ack_ = 0;
+
+        // Length of the TCP header and payload (on the wire and captured)
+        uint32_t len_;
+        uint32_t caplen_;
 
         const Packet* ack_packet_ = nullptr;
 
@@ -235,7 +263,7 @@ class TcpPacket {
 
         // Number of unacked bytes including the payload of this packet when
         // this packet was transmitted (this does not consider preliminary
-        // ACKing by a SACK block)
+        // ACKing by a SACK block, nor later corrections kept by the endpoint)
         uint32_t unacked_bytes_ = 0;
         
         // Number of sent bytes (in-order) acked when this packet was
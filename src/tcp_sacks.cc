@@ -1,10 +1,58 @@
 #include "tcp_sacks.h"
 
+#include <algorithm>
+
 #include "util.h"
 
+// Inserts a new SACK block into the given sorted, non-overlapping blocks (with
+// room for one more block) and merges it with the blocks it overlaps.
+// Returns the number of blocks afterwards and updates the number of bytes
+// covered by the blocks
+template<typename Block>
+static size_t InsertSack(Block new_sack, Block* sacks, size_t num_sacks,
+        uint32_t* num_bytes) {
+    // Find the first block that does not precede the new one
+    size_t index = 0;
+    while (index < num_sacks &&
+            !tcp_util::Before(new_sack.end_, sacks[index].start_) &&
+            !tcp_util::Overlaps(sacks[index].start_, sacks[index].end_,
+                new_sack.start_, new_sack.end_)) {
+        index++;
+    }
+
+    // Extend the range of the new block by all blocks it overlaps
+    size_t next_index = index;
+    while (next_index < num_sacks &&
+            tcp_util::Overlaps(new_sack.start_, new_sack.end_,
+                sacks[next_index].start_, sacks[next_index].end_)) {
+        const Block& sack = sacks[next_index];
+        if (tcp_util::Before(sack.start_, new_sack.start_)) {
+            new_sack.start_ = sack.start_;
+        }
+        if (tcp_util::After(sack.end_, new_sack.end_)) {
+            new_sack.end_ = sack.end_;
+        }
+        *num_bytes -= sack.end_ - sack.start_;
+        next_index++;
+    }
+
+    // Replace the merged blocks by the new one
+    if (next_index == index) {
+        std::copy_backward(sacks + index, sacks + num_sacks,
+                sacks + num_sacks + 1);
+    } else {
+        std::copy(sacks + next_index, sacks + num_sacks, sacks + index + 1);
+    }
+    sacks[index] = new_sack;
+    *num_bytes += new_sack.end_ - new_sack.start_;
+
+    return num_sacks + 1 - (next_index - index);
+}
+
 bool TcpSacks::Parse(const u_char* option, const size_t caplen) {
-    sacks_.clear();
+    num_stored_sacks_ = 0;
     num_sacks_ = 0;
+    num_bytes_ = 0;
 
     if (caplen < 2) {
         // Did not capture option size, so we cannot do anything here
@@ -28,88 +76,42 @@ bool TcpSacks::Parse(const u_char* option, const size_t caplen) {
         Add(sack);
         used_bytes += 8;
     }
-    Merge();
-    UpdateNumBytes();
 
     return true;
 }
 
 void TcpSacks::Add(Sack new_sack) {
-    for (auto current_sack = sacks_.begin();
-            current_sack != sacks_.end(); ++current_sack) {
-        if (tcp_util::Before(new_sack.end_, current_sack->start_)) {
-            // New item precedes current SACK
-            sacks_.insert(current_sack, new_sack);
-            UpdateNumBytes();
-            return;
-        }
-        else if (tcp_util::Overlaps(
-                    current_sack->start_, current_sack->end_,
-                    new_sack.start_, new_sack.end_)) {
-            // New item overlaps with current SACK, therefore extend the
-            // existing range
-            sacks_.insert(current_sack, new_sack);
-            Merge();
-            UpdateNumBytes();
-            return;
-        }
+    if (num_stored_sacks_ == kMaxSacks) {
+        return;
     }
-
-    // New item does not precede any existing SACK, so it's added to the end of
-    // the list
-    sacks_.push_back(new_sack);
+    num_stored_sacks_ =
+        InsertSack(new_sack, sacks_, num_stored_sacks_, &num_bytes_);
 }
 
-void TcpSacks::Add(TcpSacks new_sacks) {
-    for (Sack new_sack : new_sacks.sacks_) {
-        Add(new_sack);
-    }
+void MergedSacks::Add(UnwrappedSack new_sack) {
+    // Make room for the new block, merging only ever removes blocks
+    sacks_.emplace_back();
+    sacks_.resize(InsertSack(new_sack, sacks_.data(), sacks_.size() - 1,
+                &num_bytes_));
 }
 
-void TcpSacks::Merge() {
-    if (sacks_.size() < 2) {
-        return;
-    }
-    auto current_sack = sacks_.begin();
-    auto next_sack = std::next(current_sack, 1);
-    while (next_sack != sacks_.end()) {
-        if (tcp_util::Overlaps(
-                    current_sack->start_, current_sack->end_,
-                    next_sack->start_, next_sack->end_)) {
-            // Extend the range of the first SACK and remove the second
-            // (overlapping) one
-            if (tcp_util::Before(next_sack->start_, current_sack->start_)) {
-                current_sack->start_ = next_sack->start_;
-            }
-            if (tcp_util::After(next_sack->end_, current_sack->end_)) {
-                current_sack->end_ = next_sack->end_;
-            }
-            next_sack = sacks_.erase(next_sack);
-        } else {
-            current_sack = next_sack;
-            ++next_sack;
-        }
+void MergedSacks::Add(const TcpSacks& new_sacks, uint64_t seq_reference) {
+    for (const Sack& new_sack : new_sacks.sacks()) {
+        Add({tcp_util::Unwrap(new_sack.start_, seq_reference),
+             tcp_util::Unwrap(new_sack.end_, seq_reference)});
     }
 }
 
-void TcpSacks::RemoveAcked(uint32_t seq_acked) {
+void MergedSacks::RemoveAcked(uint64_t seq_acked) {
     auto current_sack = sacks_.begin();
-    while (current_sack != sacks_.end()) {
-        if (!tcp_util::After(current_sack->end_, seq_acked)) {
-            current_sack = sacks_.erase(current_sack);
-            continue;
-        }
-        if (tcp_util::Before(current_sack->start_, seq_acked)) {
-            current_sack->start_ = seq_acked;
-        }
-        break;
+    while (current_sack != sacks_.end() && current_sack->end_ <= seq_acked) {
+        num_bytes_ -= current_sack->end_ - current_sack->start_;
+        ++current_sack;
     }
-    UpdateNumBytes();
-}
+    current_sack = sacks_.erase(sacks_.begin(), current_sack);
 
-void TcpSacks::UpdateNumBytes() {
-    num_bytes_ = 0;
-    for (auto sack : sacks_) {
-        num_bytes_ += (sack.end_ - sack.start_);
+    if (current_sack != sacks_.end() && current_sack->start_ < seq_acked) {
+        num_bytes_ -= seq_acked - current_sack->start_;
+        current_sack->start_ = seq_acked;
     }
 }
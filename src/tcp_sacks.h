@@ -1,9 +1,9 @@
 #ifndef TCP_SACKS_H_
 #define TCP_SACKS_H_
 
-#include <list>
 #include <netinet/in.h>
 #include <pcap.h>
+#include <vector>
 #include "stdint.h"
 
 typedef struct Sack {
@@ -11,8 +11,48 @@ typedef struct Sack {
     uint32_t end_;
 } Sack;
 
+// SACK block with unwrapped (64-bit) sequence numbers
+typedef struct UnwrappedSack {
+    uint64_t start_;
+    uint64_t end_;
+} UnwrappedSack;
+
+// Read-only view of consecutive SACK blocks (valid until the blocks change)
+template<typename Block>
+class BlockSpan {
+    public:
+        BlockSpan(const Block* begin, const Block* end)
+                : begin_(begin),
+                  end_(end) {}
+
+        inline const Block* begin() const {
+            return begin_;
+        }
+        inline const Block* end() const {
+            return end_;
+        }
+        inline size_t size() const {
+            return end_ - begin_;
+        }
+        inline bool empty() const {
+            return begin_ == end_;
+        }
+
+    private:
+        const Block* begin_;
+        const Block* end_;
+};
+
+typedef BlockSpan<Sack> SackSpan;
+typedef BlockSpan<UnwrappedSack> UnwrappedSackSpan;
+
+// SACK blocks of a single packet. The blocks are stored inline, since the
+// option carries at most 4 of them
 class TcpSacks {
     public:
+        // Maximum number of SACK blocks fitting into the options (40 bytes)
+        static constexpr size_t kMaxSacks = 4;
+
         inline bool empty() const {
             return num_sacks_ == 0;
         }
@@ -22,33 +62,23 @@ class TcpSacks {
         inline uint32_t num_bytes() const {
             return num_bytes_;
         }
-        inline std::list<Sack> sacks() const {
-            return sacks_;
+        inline SackSpan sacks() const {
+            return SackSpan(sacks_, sacks_ + num_stored_sacks_);
         }
 
         // Parses the SACK option. Returns TRUE if parsing was successful
         bool Parse(const u_char* option, const size_t caplen);
 
-        // Adds a new SACK block to the given list and potentially merges
-        // existing ranges
+        // Adds a new SACK block and potentially merges existing ranges
+        // (at most kMaxSacks blocks can be added)
         void Add(Sack new_sack);
-
-        // Adds new SACK blocks to the given list and potentially merges
-        // existing ranges
-        void Add(TcpSacks new_sacks);
-
-        // Merge overlapping SACK blocks
-        void Merge();
-
-        // Move or cut all ranges that precede the given ACK number
-        void RemoveAcked(uint32_t seq_acked);
     
     private:
-        // Recompute the number of bytes covered by the SACK blocks
-        void UpdateNumBytes();
+        Sack sacks_[kMaxSacks];
+
+        // Number of blocks stored above (after merging)
+        size_t num_stored_sacks_ = 0;
 
-        std::list<Sack> sacks_;
-        
         // The options block of a packet header might be truncated and
         // we potentially did not see the actual SACK blocks and can only
         // compute the number of SACK blocks passed on the length of the
@@ -62,5 +92,38 @@ class TcpSacks {
         uint32_t num_bytes_ = 0;
 };
 
-#endif  /* TCP_SACKS_H_ */
+// Union of the SACK blocks seen in multiple ACKs, stored as sorted
+// non-overlapping ranges of unwrapped sequence numbers. Adding blocks only
+// moves ranges within a vector, so (once the vector has grown) no memory is
+// allocated
+class MergedSacks {
+    public:
+        inline bool empty() const {
+            return sacks_.empty();
+        }
+        inline uint32_t num_bytes() const {
+            return num_bytes_;
+        }
+        inline UnwrappedSackSpan sacks() const {
+            return UnwrappedSackSpan(sacks_.data(),
+                    sacks_.data() + sacks_.size());
+        }
+
+        // Adds a new SACK block and potentially merges existing ranges
+        void Add(UnwrappedSack new_sack);
 
+        // Adds the SACK blocks of a packet, whose sequence numbers are
+        // unwrapped around the given one
+        void Add(const TcpSacks& new_sacks, uint64_t seq_reference);
+
+        // Move or cut all ranges that precede the given ACK number
+        void RemoveAcked(uint64_t seq_acked);
+
+    private:
+        std::vector<UnwrappedSack> sacks_;
+
+        // Number of bytes covered by the SACK blocks (updated along with them)
+        uint32_t num_bytes_ = 0;
+};
+
+#endif  /* TCP_SACKS_H_ */
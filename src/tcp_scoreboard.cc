@@ -0,0 +1,66 @@
+#include "tcp_scoreboard.h"
+
+#include <algorithm>
+
+#include "tcp_packet.h"
+#include "util.h"
+
+// Offset of the first added sequence number, s.t. sequence numbers up to 2^31
+// before or after it map to ordered offsets
+constexpr uint32_t kBaseOffset = 0x80000000;
+
+void TcpScoreboard::Add(Packet* packet) {
+    const TcpPacket& tcp = *(packet->tcp());
+    if (num_packets_added_ == 0) {
+        base_seq_ = tcp.seq() - kBaseOffset;
+    }
+
+    // New data usually ends after all unacked packets, in which case the
+    // hint makes the insertion constant time
+    packets_.emplace_hint(packets_.end(),
+            Key(ToOffset(tcp.seq_end()), num_packets_added_++), packet);
+}
+
+TcpScoreboard::Iterator TcpScoreboard::Erase(Iterator it) {
+    return Iterator(packets_.erase(it.it_));
+}
+
+void TcpScoreboard::RemoveAcked(uint32_t seq_acked, const TcpSacks& sacks,
+        std::vector<Packet*>* acked_packets) {
+    removed_packets_.clear();
+
+    // Cumulatively acked packets are at the front
+    const uint32_t acked_offset = ToOffset(seq_acked);
+    auto entry = packets_.begin();
+    while (entry != packets_.end() && entry->first.first <= acked_offset) {
+        removed_packets_.emplace_back(entry->first.second, entry->second);
+        entry = packets_.erase(entry);
+    }
+
+    // Packets carried by a SACK block end within it. Offsets do not wrap
+    // around, so the ranges are compared as 64-bit numbers
+    for (const Sack& sack : sacks.sacks()) {
+        const uint64_t start_offset = ToOffset(sack.start_);
+        const uint64_t end_offset = ToOffset(sack.end_);
+        entry = packets_.lower_bound(Key(start_offset, 0));
+        while (entry != packets_.end() && entry->first.first <= end_offset) {
+            const uint64_t packet_end_offset = entry->first.first;
+            const uint64_t packet_start_offset =
+                packet_end_offset - entry->second->tcp()->data_len();
+            if (tcp_util::RangeIncluded(packet_start_offset, packet_end_offset,
+                        start_offset, end_offset)) {
+                removed_packets_.emplace_back(entry->first.second,
+                        entry->second);
+                entry = packets_.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    std::sort(removed_packets_.begin(), removed_packets_.end());
+    acked_packets->clear();
+    for (const auto& removed_packet : removed_packets_) {
+        acked_packets->push_back(removed_packet.second);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef TCP_SCOREBOARD_H_
+#define TCP_SCOREBOARD_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "packet.h"
+#include "tcp_sacks.h"
+
+// Packets of an endpoint that have not been acknowledged yet, ordered by the
+// end of their sequence range (and their transmission order for equal ends).
+// Cumulative ACKs remove packets from the front and SACK blocks only visit the
+// packets ending within them. Like in TcpTxIndex, sequence numbers are mapped
+// to offsets around the first added sequence number to keep their order
+// across wraparound
+class TcpScoreboard {
+    public:
+        // Packets keyed by the end offset of their sequence range and their
+        // transmission order
+        typedef std::pair<uint32_t, uint32_t> Key;
+        typedef std::map<Key, Packet*> PacketMap;
+
+        // Iterates over the packets in sequence order
+        class Iterator {
+            public:
+                inline Packet* operator*() const {
+                    return it_->second;
+                }
+                inline Iterator& operator++() {
+                    ++it_;
+                    return *this;
+                }
+                inline bool operator!=(const Iterator& other) const {
+                    return it_ != other.it_;
+                }
+
+            private:
+                explicit Iterator(PacketMap::const_iterator it) : it_(it) {}
+
+                PacketMap::const_iterator it_;
+
+                friend class TcpScoreboard;
+        };
+
+        inline bool empty() const {
+            return packets_.empty();
+        }
+        inline size_t size() const {
+            return packets_.size();
+        }
+        inline Iterator begin() const {
+            return Iterator(packets_.begin());
+        }
+        inline Iterator end() const {
+            return Iterator(packets_.end());
+        }
+
+        // Adds the next packet transmitted by the endpoint (i.e. packets have
+        // to be added in transmission order)
+        void Add(Packet* packet);
+
+        // Removes the given packet and returns the iterator to the next one
+        Iterator Erase(Iterator it);
+
+        // Removes all packets that are acked by the given ACK number or
+        // carried within one of the given SACK blocks and stores them in
+        // transmission order
+        void RemoveAcked(uint32_t seq_acked, const TcpSacks& sacks,
+                std::vector<Packet*>* acked_packets);
+
+    private:
+        inline uint32_t ToOffset(uint32_t seq) const {
+            return seq - base_seq_;
+        }
+
+        // Sequence number that maps to offset 0
+        uint32_t base_seq_ = 0;
+
+        uint32_t num_packets_added_ = 0;
+
+        PacketMap packets_;
+
+        // Packets removed by the current ACK (with their transmission order)
+        std::vector<std::pair<uint32_t, Packet*>> removed_packets_;
+};
+
+#endif  /* TCP_SCOREBOARD_H_ */
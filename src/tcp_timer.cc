@@ -19,7 +19,7 @@ uint64_t TcpTimerInfo::fire_us() const {
 }
 
 void TcpTimer::AddSample(const Packet* packet,
-        const uint32_t seq_acked, const uint32_t seq_next) {
+        const uint64_t seq_acked, const uint64_t seq_next) {
     RttSample sample = {
         packet,
         static_cast<int32_t>(packet->tcp()->ack_delay_us()),
@@ -78,7 +78,7 @@ void TcpTimer::AddSample(RttSample sample) {
     }
 
     // Otherwise we update once per RTT and ensure that 
-    if (tcp_util::After(sample.seq_acked_, next_seq_)) {
+    if (sample.seq_acked_ > next_seq_) {
         if (max_mean_dev_x4_ < rtt_var_x4_) {
             rtt_var_x4_ -= (rtt_var_x4_ - max_mean_dev_x4_) >> 2;
         }
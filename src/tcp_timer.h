@@ -12,8 +12,8 @@
 typedef struct {
     const Packet* packet_;
     int32_t rtt_us_; 
-    uint32_t seq_acked_;
-    uint32_t seq_next_;
+    uint64_t seq_acked_;
+    uint64_t seq_next_;
 } RttSample;
 
 class TcpTimer {
@@ -37,7 +37,7 @@ class TcpTimer {
         // RTOs
         static uint32_t AdjustRTOForBackoff(uint32_t rto, uint8_t num_rtos);
 
-        inline std::vector<RttSample> samples() const {
+        inline const std::vector<RttSample>& samples() const {
             return samples_;
         }
 
@@ -45,7 +45,7 @@ class TcpTimer {
         // following RFC 6298 and the Linux kernel implementation
         void AddSample(RttSample sample);
         void AddSample(const Packet* packet,
-                const uint32_t seq_acked, const uint32_t seq_next);
+                const uint64_t seq_acked, const uint64_t seq_next);
 
         // Returns the current estimate for the retransmission timeout (RTO)
         // incorporating backoffs due to consecutive RTOs
@@ -76,7 +76,7 @@ class TcpTimer {
         // Next sequence number upon which the RTT estimate is updated (unless
         // the RTT spiked up significantly before, in which case an update is
         // immediate)
-        uint32_t next_seq_ = 0;
+        uint64_t next_seq_ = 0;
 
         std::vector<RttSample> samples_;
 };
@@ -0,0 +1,108 @@
+#include "tcp_tx_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "tcp_packet.h"
+#include "util.h"
+
+// Offset of the first indexed sequence number, s.t. sequence numbers up to
+// 2^31 before or after it map to ordered offsets
+constexpr uint32_t kBaseOffset = 0x80000000;
+
+void TcpTxIndex::Add(Packet* packet) {
+    const TcpPacket& tcp = *(packet->tcp());
+    if (num_txs_ == 0) {
+        base_seq_ = tcp.seq() - kBaseOffset;
+    }
+    const Tx tx = {num_txs_++, packet};
+    const uint32_t start = ToOffset(tcp.seq());
+    const uint32_t end = start + tcp.data_len();
+
+    if (tcp.is_rtx()) {
+        rtxs_[start].push_back(tx);
+        max_rtx_len_ = std::max(max_rtx_len_, tcp.data_len());
+    }
+    if (start == end) {
+        empty_txs_[start] = tx;
+        return;
+    }
+
+    // The packet is the latest transmission of its whole range, so cut the
+    // overlapping parts from all ranges covered before
+    auto range = tx_ranges_.lower_bound(start);
+    if (range != tx_ranges_.begin()) {
+        TxRange& previous_range = std::prev(range)->second;
+        if (previous_range.end_ > end) {
+            tx_ranges_.emplace(end, previous_range);
+        }
+        if (previous_range.end_ > start) {
+            previous_range.end_ = start;
+        }
+    }
+    while (range != tx_ranges_.end() && range->first < end) {
+        if (range->second.end_ > end) {
+            tx_ranges_.emplace(end, range->second);
+        }
+        range = tx_ranges_.erase(range);
+    }
+    tx_ranges_.emplace(start, TxRange{end, tx});
+}
+
+Packet* TcpTxIndex::FindLatestTx(uint32_t seq) const {
+    const uint32_t offset = ToOffset(seq);
+    const Tx* latest_tx = nullptr;
+
+    auto range = tx_ranges_.upper_bound(offset);
+    if (range != tx_ranges_.begin() && std::prev(range)->second.end_ > offset) {
+        latest_tx = &std::prev(range)->second.tx_;
+    }
+    auto empty_tx = empty_txs_.find(offset);
+    if (empty_tx != empty_txs_.end() &&
+            (latest_tx == nullptr || empty_tx->second.order_ > latest_tx->order_)) {
+        latest_tx = &empty_tx->second;
+    }
+
+    return latest_tx != nullptr ? latest_tx->packet_ : nullptr;
+}
+
+Packet* TcpTxIndex::TakeLatestRtx(uint32_t seq_start, uint32_t seq_end) {
+    const uint32_t offset = ToOffset(seq_start);
+    auto rtxs = offset > max_rtx_len_ ?
+        rtxs_.lower_bound(offset - max_rtx_len_) : rtxs_.begin();
+
+    // Find the latest retransmission carrying the range among all that start
+    // close enough before it
+    auto latest_rtxs = rtxs_.end();
+    std::vector<Tx>::iterator latest_rtx;
+    // (offsets do not wrap around, so ranges are compared as 64-bit numbers)
+    const uint64_t start_offset = offset;
+    const uint64_t end_offset = ToOffset(seq_end);
+    for (; rtxs != rtxs_.end() && rtxs->first <= offset; ++rtxs) {
+        const uint64_t rtx_start_offset = rtxs->first;
+        for (auto rtx = rtxs->second.rbegin(); rtx != rtxs->second.rend();
+                ++rtx) {
+            const uint64_t rtx_end_offset =
+                rtx_start_offset + rtx->packet_->tcp()->data_len();
+            if (tcp_util::RangeIncluded(start_offset, end_offset,
+                        rtx_start_offset, rtx_end_offset)) {
+                if (latest_rtxs == rtxs_.end() ||
+                        rtx->order_ > latest_rtx->order_) {
+                    latest_rtxs = rtxs;
+                    latest_rtx = std::prev(rtx.base());
+                }
+                break;
+            }
+        }
+    }
+    if (latest_rtxs == rtxs_.end()) {
+        return nullptr;
+    }
+
+    Packet* packet = latest_rtx->packet_;
+    latest_rtxs->second.erase(latest_rtx);
+    if (latest_rtxs->second.empty()) {
+        rtxs_.erase(latest_rtxs);
+    }
+    return packet;
+}
@@ -0,0 +1,66 @@
+#ifndef TCP_TX_INDEX_H_
+#define TCP_TX_INDEX_H_
+
+#include <map>
+#include <vector>
+
+#include "packet.h"
+
+// Index of the sequence ranges transmitted by an endpoint, s.t. earlier
+// transmissions of retransmitted data can be found without scanning all
+// packets. Sequence numbers are mapped to offsets around the first indexed
+// sequence number, so the sorted offsets follow the sequence order even if the
+// sequence numbers wrap around
+class TcpTxIndex {
+    public:
+        // Adds the next packet transmitted by the endpoint (i.e. packets have
+        // to be added in transmission order)
+        void Add(Packet* packet);
+
+        // Returns the most recent transmission that started at the given
+        // sequence or carried it (nullptr if there is none)
+        Packet* FindLatestTx(uint32_t seq) const;
+
+        // Returns the most recent retransmission that carried the given range
+        // (nullptr if there is none) and removes it from the index, i.e. the
+        // next call for the same range returns the retransmission before
+        Packet* TakeLatestRtx(uint32_t seq_start, uint32_t seq_end);
+
+    private:
+        typedef struct {
+            // Number of packets added before this one
+            uint32_t order_;
+            Packet* packet_;
+        } Tx;
+
+        // Range of offsets (starting at the key in the map) and the latest
+        // transmission that carried it
+        typedef struct {
+            uint32_t end_;
+            Tx tx_;
+        } TxRange;
+
+        inline uint32_t ToOffset(uint32_t seq) const {
+            return seq - base_seq_;
+        }
+
+        // Sequence number that maps to offset 0
+        uint32_t base_seq_ = 0;
+
+        uint32_t num_txs_ = 0;
+
+        // Non-overlapping ranges covering all transmitted payload
+        std::map<uint32_t, TxRange> tx_ranges_;
+
+        // Latest transmission without payload (e.g. pure ACKs) for each offset
+        std::map<uint32_t, Tx> empty_txs_;
+
+        // Retransmissions (in transmission order) for each starting offset
+        std::map<uint32_t, std::vector<Tx>> rtxs_;
+
+        // Payload length of the longest retransmission. Only retransmissions
+        // starting at most this far before a sequence can carry it
+        uint32_t max_rtx_len_ = 0;
+};
+
+#endif  /* TCP_TX_INDEX_H_ */
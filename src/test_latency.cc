@@ -1,16 +1,88 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "arena.h"
 #include "delay_analysis.h"
+#include "fenwick_tree.h"
+#include "mapped_pcap.h"
+#include "packet_filter.h"
+#include "reorder_buffer.h"
+#include "sharded_flow_map.h"
 #include "tcp_flow_map.h"
+#include "tcp_scoreboard.h"
+#include "tcp_tx_index.h"
+#include "tgz_archive.h"
+#include "unacked_bytes_rtt_window.h"
+#include "worst_packet_index.h"
+
+// Fills the given buffer with an Ethernet/IPv4/TCP frame without payload.
+// Addresses are given in network byte order
+static void MakeTcpFrame(u_char* frame, uint32_t src_addr, uint16_t src_port,
+        uint32_t dst_addr, uint16_t dst_port, uint8_t flags, uint32_t seq,
+        uint32_t ack) {
+    memset(frame, 0, sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr));
+    auto ether = reinterpret_cast<struct ether_header*>(frame);
+    ether->ether_type = htons(ETHERTYPE_IP);
+
+    auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+    ip_header->ip_hl = 5;
+    ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr));
+    ip_header->ip_p = IPPROTO_TCP;
+    ip_header->ip_src.s_addr = src_addr;
+    ip_header->ip_dst.s_addr = dst_addr;
+
+    auto tcp_header = reinterpret_cast<struct tcphdr*>(
+            frame + sizeof(ether_header) + sizeof(ip));
+    tcp_header->th_sport = htons(src_port);
+    tcp_header->th_dport = htons(dst_port);
+    tcp_header->th_seq = htonl(seq);
+    tcp_header->th_ack = htonl(ack);
+    tcp_header->th_off = 5;
+    tcp_header->th_flags = flags;
+}
+
+// Reads the whole given file
+static std::vector<u_char> ReadFile(const char* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<u_char>(std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+}
+
+// Appends an entry with the given name, type and data to a tar archive
+static void WriteTarEntry(gzFile archive, const std::string& name, char type,
+        const std::vector<u_char>& data) {
+    char header[512] = {0};
+    strncpy(header, name.c_str(), 100);
+    snprintf(header + 100, 8, "%07o", 0644);
+    snprintf(header + 124, 12, "%011lo", (unsigned long) data.size());
+    header[156] = type;
+    memcpy(header + 257, "ustar", 5);
+    memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (u_char byte : header) {
+        checksum += byte;
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+    gzwrite(archive, header, sizeof(header));
+
+    const std::vector<u_char> padding((512 - data.size() % 512) % 512, 0);
+    gzwrite(archive, data.data(), data.size());
+    gzwrite(archive, padding.data(), padding.size());
+}
 
 TEST(LatencyTest, Basic) {
     TcpFlowMapFactory flow_map_factory;
     auto flow_map = flow_map_factory.MakeFromPcap("tests/basic.pcap");
 
     ASSERT_NE(nullptr, flow_map);
-    ASSERT_EQ(1, flow_map->map().size());
+    ASSERT_EQ(1, flow_map->num_flows());
 
-    const TcpFlow* flow = flow_map->map().begin()->second.get();
+    const TcpFlow* flow = flow_map->GetFlows().front();
     ASSERT_NE(nullptr, flow);
 
     const TcpEndpoint* a = flow->endpoint_a();
@@ -49,9 +121,9 @@ TEST(LatencyTest, TLPAndRTO) {
     auto flow_map = flow_map_factory.MakeFromPcap("tests/tlp-and-rto.pcap");
 
     ASSERT_NE(nullptr, flow_map);
-    ASSERT_EQ(1, flow_map->map().size());
+    ASSERT_EQ(1, flow_map->num_flows());
 
-    const TcpFlow* flow = flow_map->map().begin()->second.get();
+    const TcpFlow* flow = flow_map->GetFlows().front();
     ASSERT_NE(nullptr, flow);
 
     const TcpEndpoint* a = flow->endpoint_a();
@@ -80,9 +152,9 @@ TEST(LatencyTest, RTOOnly) {
     auto flow_map = flow_map_factory.MakeFromPcap("tests/rto-only.pcap");
 
     ASSERT_NE(nullptr, flow_map);
-    ASSERT_EQ(1, flow_map->map().size());
+    ASSERT_EQ(1, flow_map->num_flows());
 
-    const TcpFlow* flow = flow_map->map().begin()->second.get();
+    const TcpFlow* flow = flow_map->GetFlows().front();
     ASSERT_NE(nullptr, flow);
 
     const TcpEndpoint* a = flow->endpoint_a();
@@ -111,9 +183,9 @@ TEST(LatencyTest, RTOAndSlowStart) {
     auto flow_map = flow_map_factory.MakeFromPcap("tests/rto-and-slow-start.pcap");
 
     ASSERT_NE(nullptr, flow_map);
-    ASSERT_EQ(1, flow_map->map().size());
+    ASSERT_EQ(1, flow_map->num_flows());
 
-    const TcpFlow* flow = flow_map->map().begin()->second.get();
+    const TcpFlow* flow = flow_map->GetFlows().front();
     ASSERT_NE(nullptr, flow);
 
     const TcpEndpoint* a = flow->endpoint_a();
@@ -142,9 +214,9 @@ TEST(LatencyTest, QueuingOnly) {
     auto flow_map = flow_map_factory.MakeFromPcap("tests/queuing-only.pcap");
 
     ASSERT_NE(nullptr, flow_map);
-    ASSERT_EQ(1, flow_map->map().size());
+    ASSERT_EQ(1, flow_map->num_flows());
 
-    const TcpFlow* flow = flow_map->map().begin()->second.get();
+    const TcpFlow* flow = flow_map->GetFlows().front();
     ASSERT_NE(nullptr, flow);
 
     const TcpEndpoint* a = flow->endpoint_a();
@@ -166,3 +238,950 @@ TEST(LatencyTest, QueuingOnly) {
     EXPECT_NEAR(latency_b.queueing_us_, 100E3, 10E3);
     EXPECT_NEAR(latency_b.other_us_, 50E3, 10E3);
 }
+
+TEST(LatencyTest, HeadersOnly) {
+    // Dropping the payload at ingest must not change the analysis (the trace
+    // contains super-packets that are split into on-the-wire packets)
+    TcpFlowMapFactory flow_map_factory;
+    TcpFlowMapFactory headers_only_factory(true);
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/tlp-and-rto.pcap");
+    auto headers_only_map =
+        headers_only_factory.MakeFromPcap("tests/tlp-and-rto.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    ASSERT_NE(nullptr, headers_only_map);
+    ASSERT_EQ(1, headers_only_map->num_flows());
+
+    const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+    const TcpEndpoint* headers_only_b =
+        headers_only_map->GetFlows().front()->endpoint_b();
+    ASSERT_EQ(b->packets().size(), headers_only_b->packets().size());
+    for (const Packet* packet : headers_only_b->packets()) {
+        EXPECT_EQ(packet->headers_caplen(), packet->caplen());
+    }
+    EXPECT_EQ(b->GetNumDataPackets(), headers_only_b->GetNumDataPackets());
+    EXPECT_EQ(b->GetNumLosses(), headers_only_b->GetNumLosses());
+
+    DelayAnalysis delay(*b);
+    DelayAnalysis headers_only_delay(*headers_only_b);
+    const Delays latency = delay.AnalyzeTailLatency();
+    const Delays headers_only_latency = headers_only_delay.AnalyzeTailLatency();
+    EXPECT_EQ(latency.overall_us_, headers_only_latency.overall_us_);
+    EXPECT_EQ(latency.loss_us_, headers_only_latency.loss_us_);
+    EXPECT_EQ(latency.queueing_us_, headers_only_latency.queueing_us_);
+}
+
+TEST(LatencyTest, WirePacketSlices) {
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/tlp-and-rto.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+
+    // Super-packets are split into slices that share the captured bytes and
+    // carry consecutive parts of the payload
+    uint32_t num_slices = 0;
+    const Packet* previous_packet = nullptr;
+    for (const Packet* packet : b->packets()) {
+        if (previous_packet != nullptr &&
+                packet->packet() == previous_packet->packet()) {
+            EXPECT_EQ(previous_packet->tcp()->seq_end(), packet->tcp()->seq());
+            EXPECT_EQ(previous_packet->timestamp_us(), packet->timestamp_us());
+            num_slices++;
+        }
+        previous_packet = packet;
+    }
+    EXPECT_LT(0, num_slices);
+}
+
+TEST(MappedPcapTest, ReadsAllRecords) {
+    auto mapped_pcap = MappedPcap::Open("tests/basic.pcap");
+    ASSERT_NE(nullptr, mapped_pcap);
+    EXPECT_EQ(DLT_EN10MB, mapped_pcap->datalink_type());
+
+    struct pcap_pkthdr pcap_header;
+    u_char* packet;
+    uint32_t num_packets = 0;
+    while (mapped_pcap->Next(&pcap_header, &packet)) {
+        EXPECT_LE(pcap_header.caplen, pcap_header.len);
+        num_packets++;
+    }
+    EXPECT_EQ(1883, num_packets);
+    EXPECT_FALSE(mapped_pcap->is_truncated());
+
+    // Files that are not classic PCAP files are left to libpcap
+    EXPECT_EQ(nullptr, MappedPcap::Open("tests/packetdrill/rto-only.pkt"));
+    EXPECT_EQ(nullptr, MappedPcap::Open("tests/does-not-exist.pcap"));
+}
+
+TEST(ArenaTest, AllocatesAndDestroys) {
+    int num_destroyed = 0;
+    struct Counter {
+        explicit Counter(int* num_destroyed) : num_destroyed_(num_destroyed) {}
+        ~Counter() { (*num_destroyed_)++; }
+        int* num_destroyed_;
+    };
+
+    {
+        Arena arena;
+        const u_char bytes[3] = {1, 2, 3};
+        u_char* copy = arena.Copy(bytes, sizeof(bytes));
+        EXPECT_EQ(0, memcmp(bytes, copy, sizeof(bytes)));
+
+        // Objects are aligned and may span multiple blocks
+        for (size_t i = 0; i < Arena::kMinBlockSize; i++) {
+            uint64_t* value = arena.Make<uint64_t>(i);
+            EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(value) % alignof(uint64_t));
+            EXPECT_EQ(i, *value);
+        }
+        arena.Make<Counter>(&num_destroyed);
+        arena.Make<Counter>(&num_destroyed);
+        EXPECT_EQ(0, num_destroyed);
+    }
+    EXPECT_EQ(2, num_destroyed);
+}
+
+TEST(TcpFlowMapTest, MatchesBothDirections) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    // Create flows in reverse order of their IDs with a handshake each
+    TcpFlowMap flow_map;
+    constexpr uint16_t kNumFlows = 100;
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    for (uint16_t i = 0; i < kNumFlows; i++) {
+        const uint16_t client_port = 50000 - i;
+        MakeTcpFrame(frame, client_addr, client_port, server_addr, 80,
+                TH_SYN, 1000, 0);
+        Packet syn(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&syn, true));
+
+        MakeTcpFrame(frame, server_addr, 80, client_addr, client_port,
+                TH_SYN|TH_ACK, 5000, 1001);
+        Packet syn_ack(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&syn_ack, true));
+    }
+    ASSERT_EQ(kNumFlows, flow_map.num_flows());
+
+    // Flows are ordered by ID and keyed by the direction of the first packet
+    auto flows = flow_map.GetFlows();
+    for (uint16_t i = 0; i < kNumFlows; i++) {
+        EXPECT_EQ(client_addr, flows[i]->id().src_addr);
+        EXPECT_EQ(50000 - kNumFlows + 1 + i, flows[i]->id().src_port);
+        ASSERT_NE(nullptr, flows[i]->endpoint_b());
+        EXPECT_EQ(1, flows[i]->endpoint_a()->packets().size());
+        EXPECT_EQ(1, flows[i]->endpoint_b()->packets().size());
+    }
+}
+
+TEST(TcpFlowMapTest, StreamsDoneFlows) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    TcpFlowMap flow_map;
+    std::vector<uint32_t> finalized_flows;
+    flow_map.EnableStreaming([&finalized_flows](const TcpFlow& flow) {
+        finalized_flows.push_back(flow.index());
+    }, 10000000);
+
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    auto add_packet = [&](uint16_t client_port, uint8_t flags, bool from_client,
+            time_t timestamp_s) {
+        if (from_client) {
+            MakeTcpFrame(frame, client_addr, client_port, server_addr, 80,
+                    flags, 1000, flags & TH_ACK ? 5001 : 0);
+        } else {
+            MakeTcpFrame(frame, server_addr, 80, client_addr, client_port,
+                    flags, 5000, 1001);
+        }
+        pcap_header.ts.tv_sec = timestamp_s;
+        Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+    };
+
+    // Flow 0 is reset, flow 1 stays open
+    add_packet(40000, TH_SYN, true, 0);
+    add_packet(40000, TH_SYN|TH_ACK, false, 0);
+    add_packet(40000, TH_RST, true, 0);
+    add_packet(40001, TH_SYN, true, 0);
+    EXPECT_TRUE(finalized_flows.empty());
+
+    // The closed flow is finalized after lingering, the open one after the
+    // idle timeout
+    add_packet(40002, TH_SYN, true, 2);
+    EXPECT_EQ(std::vector<uint32_t>({0}), finalized_flows);
+    EXPECT_EQ(2, flow_map.num_flows());
+    add_packet(40002, TH_SYN|TH_ACK, false, 20);
+    EXPECT_EQ(std::vector<uint32_t>({0, 1}), finalized_flows);
+    EXPECT_EQ(1, flow_map.num_flows());
+
+    flow_map.FinalizeAllFlows();
+    EXPECT_EQ(std::vector<uint32_t>({0, 1, 2}), finalized_flows);
+    EXPECT_EQ(0, flow_map.num_flows());
+}
+
+TEST(ShardedFlowMapTest, MatchesSingleMap) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    // Interleave the handshakes of all flows
+    TcpFlowMap flow_map;
+    ShardedFlowMap sharded_flow_map(4, false);
+    constexpr uint16_t kNumFlows = 100;
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    for (uint8_t flags : {TH_SYN, TH_SYN|TH_ACK, TH_ACK}) {
+        for (uint16_t i = 0; i < kNumFlows; i++) {
+            const uint16_t client_port = 50000 - i;
+            if (flags == (TH_SYN|TH_ACK)) {
+                MakeTcpFrame(frame, server_addr, 80, client_addr, client_port,
+                        flags, 5000, 1001);
+            } else {
+                MakeTcpFrame(frame, client_addr, client_port, server_addr, 80,
+                        flags, 1000 + (flags & TH_ACK ? 1 : 0),
+                        flags & TH_ACK ? 5001 : 0);
+            }
+            Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+            EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+            Packet sharded_packet(frame, &pcap_header,
+                    LinkType<DLT_EN10MB>());
+            EXPECT_TRUE(sharded_flow_map.AddPacket(&sharded_packet, true));
+        }
+    }
+    ASSERT_TRUE(sharded_flow_map.Finish());
+    ASSERT_EQ(kNumFlows, sharded_flow_map.num_flows());
+
+    // Flows come in the same order with the same packets
+    auto flows = flow_map.GetFlows();
+    auto sharded_flows = sharded_flow_map.GetFlows();
+    for (uint16_t i = 0; i < kNumFlows; i++) {
+        EXPECT_TRUE(flows[i]->id() == sharded_flows[i]->id());
+        const auto& packets = flows[i]->endpoint_a()->packets();
+        const auto& sharded_packets =
+            sharded_flows[i]->endpoint_a()->packets();
+        ASSERT_EQ(packets.size(), sharded_packets.size());
+        for (size_t j = 0; j < packets.size(); j++) {
+            EXPECT_EQ(packets[j]->index(), sharded_packets[j]->index());
+        }
+    }
+
+    // Each flow is processed exactly once with its index
+    std::vector<const TcpFlow*> processed_flows(kNumFlows, nullptr);
+    sharded_flow_map.ProcessFlows([&processed_flows](uint32_t flow_index,
+                const TcpFlow& flow) {
+        EXPECT_EQ(nullptr, processed_flows[flow_index]);
+        processed_flows[flow_index] = &flow;
+    });
+    EXPECT_EQ(sharded_flows, processed_flows);
+}
+
+TEST(LinkTypeTest, ParsesCapturesConcurrently) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    // The same TCP/IP packet behind an Ethernet and a Linux-cooked header
+    // (16 bytes, the protocol is in the last two)
+    constexpr size_t kSllHeaderLen = 16;
+    u_char ethernet_frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    MakeTcpFrame(ethernet_frame, client_addr, 50000, server_addr, 80, TH_SYN,
+            1000, 0);
+    u_char sll_frame[kSllHeaderLen + sizeof(ip) + sizeof(tcphdr)] = {0};
+    const uint16_t protocol = htons(ETHERTYPE_IP);
+    memcpy(sll_frame + kSllHeaderLen - sizeof(protocol), &protocol,
+            sizeof(protocol));
+    memcpy(sll_frame + kSllHeaderLen, ethernet_frame + sizeof(ether_header),
+            sizeof(ip) + sizeof(tcphdr));
+
+    auto parse_frames = [&](u_char* frame, uint32_t caplen, auto link_type) {
+        struct pcap_pkthdr pcap_header = {{0, 0}, caplen, caplen};
+        TcpFlowMap flow_map;
+        for (int i = 0; i < 1000; i++) {
+            Packet packet(frame, &pcap_header, link_type);
+            ASSERT_TRUE(packet.is_tcp());
+            EXPECT_EQ(client_addr, packet.ip()->src_addr());
+            EXPECT_EQ(50000, packet.tcp()->src_port());
+            EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+        }
+        EXPECT_EQ(1000, flow_map.GetFlows().front()->endpoint_a()->
+                packets().size());
+    };
+    std::thread ethernet_thread(parse_frames, ethernet_frame,
+            sizeof(ethernet_frame), LinkType<DLT_EN10MB>());
+    std::thread sll_thread(parse_frames, sll_frame, sizeof(sll_frame),
+            LinkType<DLT_LINUX_SLL>());
+    ethernet_thread.join();
+    sll_thread.join();
+}
+
+TEST(TgzArchiveTest, ReadsPcapEntries) {
+    const std::vector<u_char> trace = ReadFile("tests/basic.pcap");
+    ASSERT_FALSE(trace.empty());
+
+    // A trace may also be gzip-compressed within the archive
+    char compressed_filename[] = "/tmp/test_latency_XXXXXX";
+    close(mkstemp(compressed_filename));
+    gzFile compressed = gzopen(compressed_filename, "wb");
+    gzwrite(compressed, trace.data(), trace.size());
+    gzclose(compressed);
+    const std::vector<u_char> compressed_trace = ReadFile(compressed_filename);
+
+    char archive_filename[] = "/tmp/test_latency_XXXXXX";
+    close(mkstemp(archive_filename));
+    gzFile archive_file = gzopen(archive_filename, "wb");
+    WriteTarEntry(archive_file, "2017/", '5', {});
+    WriteTarEntry(archive_file, "2017/a.c2s_ndttrace", '0', {1, 2, 3});
+    WriteTarEntry(archive_file, "2017/a.s2c_ndttrace", '0', trace);
+    WriteTarEntry(archive_file, "2017/b.s2c_ndttrace", '0', compressed_trace);
+    const std::vector<u_char> end_of_archive(1024, 0);
+    gzwrite(archive_file, end_of_archive.data(), end_of_archive.size());
+    gzclose(archive_file);
+
+    auto archive = TgzArchive::Open(archive_filename);
+    ASSERT_NE(nullptr, archive);
+    std::string name;
+    uint64_t size;
+    ASSERT_TRUE(archive->NextEntry(&name, &size));
+    EXPECT_EQ("2017/a.c2s_ndttrace", name);
+    EXPECT_EQ(3, size);
+
+    // Both traces are read as the original capture
+    TcpFlowMapFactory flow_map_factory;
+    for (const std::string& trace_name :
+            {"2017/a.s2c_ndttrace", "2017/b.s2c_ndttrace"}) {
+        ASSERT_TRUE(archive->NextEntry(&name, &size));
+        EXPECT_EQ(trace_name, name);
+        auto flow_map = flow_map_factory.MakeFromPcap(
+                archive->ReadPcapEntry(size));
+        ASSERT_NE(nullptr, flow_map);
+        ASSERT_EQ(1, flow_map->num_flows());
+        EXPECT_EQ(1217, flow_map->GetFlows().front()->endpoint_a()->
+                GetNumDataPackets());
+    }
+    EXPECT_FALSE(archive->NextEntry(&name, &size));
+    EXPECT_FALSE(archive->is_corrupt());
+
+    unlink(compressed_filename);
+    unlink(archive_filename);
+}
+
+TEST(ReorderBufferTest, RestoresTimestampOrder) {
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    MakeTcpFrame(frame, inet_addr("10.0.0.1"), 50000, inet_addr("10.0.0.2"),
+            80, TH_ACK, 1000, 5000);
+    std::vector<uint64_t> released_timestamps;
+    auto add_packets = [&](ReorderBuffer* reorder_buffer,
+            const std::vector<time_t>& timestamps_s) {
+        released_timestamps.clear();
+        for (time_t timestamp_s : timestamps_s) {
+            struct pcap_pkthdr pcap_header = {{timestamp_s, 0}, sizeof(frame),
+                sizeof(frame)};
+            Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+            EXPECT_TRUE(reorder_buffer->Add(&packet, true));
+        }
+        EXPECT_TRUE(reorder_buffer->Flush());
+    };
+    auto release = [&released_timestamps](Packet* packet, bool copy_bytes) {
+        EXPECT_TRUE(copy_bytes);
+        released_timestamps.push_back(packet->timestamp_us() / 1000000);
+        return true;
+    };
+
+    // Packets are displaced by at most two positions
+    ReorderBuffer reorder_buffer(2, false, release);
+    add_packets(&reorder_buffer, {3, 1, 2, 6, 4, 5});
+    EXPECT_EQ(std::vector<uint64_t>({1, 2, 3, 4, 5, 6}), released_timestamps);
+    EXPECT_EQ(4, reorder_buffer.num_reordered());
+    EXPECT_FALSE(reorder_buffer.is_overflowed());
+
+    // The last packet comes too late for the window, it is still released
+    // before the remaining packets
+    ReorderBuffer small_reorder_buffer(1, false, release);
+    add_packets(&small_reorder_buffer, {1, 3, 2, 0, 5, 4});
+    EXPECT_EQ(std::vector<uint64_t>({1, 2, 0, 3, 4, 5}), released_timestamps);
+    EXPECT_TRUE(small_reorder_buffer.is_overflowed());
+    EXPECT_EQ(1, small_reorder_buffer.num_late());
+}
+
+TEST(PacketFilterTest, SkipsNonMatchingPackets) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+
+    auto filter = PacketFilter::Compile("tcp port 3010", DLT_EN10MB);
+    ASSERT_NE(nullptr, filter);
+    MakeTcpFrame(frame, client_addr, 50000, server_addr, 3010, TH_SYN, 1000, 0);
+    EXPECT_TRUE(filter->Matches(&pcap_header, frame));
+    MakeTcpFrame(frame, client_addr, 50000, server_addr, 80, TH_SYN, 1000, 0);
+    EXPECT_FALSE(filter->Matches(&pcap_header, frame));
+    EXPECT_EQ(nullptr, PacketFilter::Compile("tcp port", DLT_EN10MB));
+
+    // The factory only adds matching packets
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/basic.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    TcpFlowMapFactory matching_factory(false, 0, "tcp port 3003");
+    auto matching_flow_map = matching_factory.MakeFromPcap("tests/basic.pcap");
+    ASSERT_NE(nullptr, matching_flow_map);
+    ASSERT_EQ(flow_map->num_flows(), matching_flow_map->num_flows());
+    EXPECT_EQ(flow_map->GetFlows()[0]->endpoint_a()->packets().size(),
+            matching_flow_map->GetFlows()[0]->endpoint_a()->packets().size());
+
+    TcpFlowMapFactory other_factory(false, 0, "tcp port 3010");
+    auto other_flow_map = other_factory.MakeFromPcap("tests/basic.pcap");
+    ASSERT_NE(nullptr, other_flow_map);
+    EXPECT_EQ(0, other_flow_map->num_flows());
+
+    TcpFlowMapFactory invalid_factory(false, 0, "tcp port");
+    EXPECT_EQ(nullptr, invalid_factory.MakeFromPcap("tests/basic.pcap"));
+}
+
+TEST(TcpTxIndexTest, FindsLatestTransmissions) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    // Packets carry payload that was not captured. Sequence numbers wrap
+    // around within the second packet
+    constexpr uint32_t kSeq = 0xFFFFFF00;
+    const std::vector<std::pair<uint32_t, uint16_t>> ranges = {
+        {kSeq, 200}, {kSeq + 200, 200}, {kSeq + 100, 200}, {kSeq + 200, 0}};
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    std::vector<std::unique_ptr<Packet>> packets;
+    TcpTxIndex tx_index;
+    for (const auto& range : ranges) {
+        MakeTcpFrame(frame, server_addr, 80, client_addr, 50000, TH_ACK,
+                range.first, 1001);
+        auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+        ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + range.second);
+        packets.emplace_back(new Packet(frame, &pcap_header,
+                    LinkType<DLT_EN10MB>()));
+        tx_index.Add(packets.back().get());
+    }
+
+    EXPECT_EQ(nullptr, tx_index.FindLatestTx(kSeq - 1));
+    EXPECT_EQ(packets[0].get(), tx_index.FindLatestTx(kSeq));
+    EXPECT_EQ(packets[0].get(), tx_index.FindLatestTx(kSeq + 99));
+    EXPECT_EQ(packets[2].get(), tx_index.FindLatestTx(kSeq + 100));
+    EXPECT_EQ(packets[3].get(), tx_index.FindLatestTx(kSeq + 200));
+    EXPECT_EQ(packets[2].get(), tx_index.FindLatestTx(kSeq + 299));
+    EXPECT_EQ(packets[1].get(), tx_index.FindLatestTx(kSeq + 300));
+    EXPECT_EQ(nullptr, tx_index.FindLatestTx(kSeq + 400));
+    EXPECT_EQ(nullptr, tx_index.TakeLatestRtx(kSeq, kSeq + 200));
+}
+
+TEST(TcpTxIndexTest, MarksSpuriousRetransmissions) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+    constexpr uint32_t kSeq = 0xFFFFFF00;
+
+    // Frames have room for a single SACK block
+    constexpr size_t kOptionsLen = 12;
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr) +
+        kOptionsLen];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    TcpFlowMap flow_map;
+    auto add_packet = [&](uint32_t src_addr, uint16_t src_port,
+            uint32_t dst_addr, uint16_t dst_port, uint8_t flags, uint32_t seq,
+            uint32_t ack, uint16_t data_len, uint32_t timestamp_ms) {
+        MakeTcpFrame(frame, src_addr, src_port, dst_addr, dst_port, flags,
+                seq, ack);
+        auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+        ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + data_len);
+        pcap_header.ts.tv_usec = timestamp_ms * 1000;
+        pcap_header.caplen = sizeof(frame) - kOptionsLen;
+        Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+    };
+    add_packet(client_addr, 50000, server_addr, 80, TH_SYN, 1000, 0, 0, 0);
+    add_packet(server_addr, 80, client_addr, 50000, TH_SYN|TH_ACK, kSeq, 1001,
+            0, 10);
+    add_packet(client_addr, 50000, server_addr, 80, TH_ACK, 1001, kSeq + 1,
+            0, 20);
+    add_packet(server_addr, 80, client_addr, 50000, TH_ACK, kSeq + 1, 1001,
+            200, 21);
+    add_packet(server_addr, 80, client_addr, 50000, TH_ACK, kSeq + 201, 1001,
+            200, 22);
+    add_packet(server_addr, 80, client_addr, 50000, TH_ACK, kSeq + 1, 1001,
+            200, 500);
+
+    // The ACK carries a DSACK for the retransmitted range
+    MakeTcpFrame(frame, client_addr, 50000, server_addr, 80, TH_ACK, 1001,
+            kSeq + 401);
+    auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+    ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + kOptionsLen);
+    auto tcp_header = reinterpret_cast<struct tcphdr*>(
+            frame + sizeof(ether_header) + sizeof(ip));
+    tcp_header->th_off = 8;
+    u_char* options = frame + sizeof(ether_header) + sizeof(ip) +
+        sizeof(tcphdr);
+    const uint32_t dsack[2] = {htonl(kSeq + 1), htonl(kSeq + 201)};
+    options[0] = options[1] = TCPOPT_NOP;
+    options[2] = TCPOPT_SACK;
+    options[3] = 10;
+    memcpy(options + 4, dsack, sizeof(dsack));
+    pcap_header.ts.tv_usec = 520000;
+    pcap_header.caplen = sizeof(frame);
+    Packet ack(frame, &pcap_header, LinkType<DLT_EN10MB>());
+    EXPECT_TRUE(flow_map.AddPacket(&ack, true));
+
+    auto flows = flow_map.GetFlows();
+    ASSERT_EQ(1, flows.size());
+    const auto& packets = flows[0]->endpoint_b()->packets();
+    ASSERT_EQ(4, packets.size());
+    EXPECT_EQ(packets[1], packets[3]->previous_tx());
+    EXPECT_EQ(packets[3], packets[1]->rtx());
+    EXPECT_TRUE(packets[3]->tcp()->is_rtx());
+    EXPECT_TRUE(packets[3]->tcp()->is_spurious_rtx());
+
+    // Unwrapped sequence numbers keep growing across the wraparound
+    EXPECT_EQ(packets[1]->tcp()->unwrapped_seq_end(),
+            packets[2]->tcp()->unwrapped_seq());
+    EXPECT_LT(packets[2]->tcp()->seq_end(), packets[2]->tcp()->seq());
+    EXPECT_EQ(packets[2]->tcp()->unwrapped_seq() + 200,
+            packets[2]->tcp()->unwrapped_seq_end());
+    EXPECT_EQ(packets[1]->tcp()->unwrapped_seq(),
+            packets[3]->tcp()->unwrapped_seq());
+}
+
+TEST(TcpScoreboardTest, RemovesAckedPackets) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+
+    // The last packet retransmits the first one. Sequence numbers wrap around
+    // within the third packet
+    constexpr uint32_t kSeq = 0xFFFFFE00;
+    const std::vector<uint32_t> seqs = {
+        kSeq, kSeq + 200, kSeq + 400, kSeq + 600, kSeq + 800, kSeq};
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    std::vector<std::unique_ptr<Packet>> packets;
+    TcpScoreboard scoreboard;
+    for (uint32_t seq : seqs) {
+        MakeTcpFrame(frame, server_addr, 80, client_addr, 50000, TH_ACK, seq,
+                1001);
+        auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+        ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + 200);
+        packets.emplace_back(new Packet(frame, &pcap_header,
+                    LinkType<DLT_EN10MB>()));
+        scoreboard.Add(packets.back().get());
+    }
+    std::vector<Packet*> ordered_packets;
+    for (Packet* packet : scoreboard) {
+        ordered_packets.push_back(packet);
+    }
+    EXPECT_EQ(std::vector<Packet*>({packets[0].get(), packets[5].get(),
+                packets[1].get(), packets[2].get(), packets[3].get(),
+                packets[4].get()}), ordered_packets);
+
+    // A SACK block only removes the packets it fully covers. Acked packets
+    // come in transmission order
+    TcpSacks sacks;
+    sacks.Add({kSeq + 550, kSeq + 800});
+    std::vector<Packet*> acked_packets;
+    scoreboard.RemoveAcked(kSeq + 200, sacks, &acked_packets);
+    EXPECT_EQ(std::vector<Packet*>({packets[0].get(), packets[3].get(),
+                packets[5].get()}), acked_packets);
+    EXPECT_EQ(3, scoreboard.size());
+
+    scoreboard.RemoveAcked(kSeq + 600, TcpSacks(), &acked_packets);
+    EXPECT_EQ(std::vector<Packet*>({packets[1].get(), packets[2].get()}),
+            acked_packets);
+    ASSERT_EQ(1, scoreboard.size());
+    EXPECT_EQ(packets[4].get(), *scoreboard.begin());
+}
+
+TEST(TcpSacksTest, MergesBlocks) {
+    // Blocks of a packet are sorted and merged
+    TcpSacks sacks;
+    sacks.Add({3000, 4000});
+    sacks.Add({1000, 2000});
+    sacks.Add({1500, 2500});
+    sacks.Add({5000, 6000});
+    ASSERT_EQ(3, sacks.sacks().size());
+    EXPECT_EQ(1000, sacks.sacks().begin()[0].start_);
+    EXPECT_EQ(2500, sacks.sacks().begin()[0].end_);
+    EXPECT_EQ(3500, sacks.num_bytes());
+
+    // Merged blocks are unwrapped around the given sequence number and keep
+    // the number of covered bytes up to date, also across wraparound
+    constexpr uint64_t kWrap = 1ULL << 32;
+    MergedSacks merged_sacks;
+    merged_sacks.Add(sacks, kWrap + 1000);
+    TcpSacks wrapped_sacks;
+    wrapped_sacks.Add({0xFFFFFF00, 100});
+    merged_sacks.Add(wrapped_sacks, kWrap + 1000);
+    merged_sacks.Add({kWrap + 2500, kWrap + 3000});
+    ASSERT_EQ(3, merged_sacks.sacks().size());
+    EXPECT_EQ(kWrap - 0x100, merged_sacks.sacks().begin()[0].start_);
+    EXPECT_EQ(1000 + 3000 + 356, merged_sacks.num_bytes());
+
+    merged_sacks.RemoveAcked(kWrap + 2000);
+    ASSERT_EQ(2, merged_sacks.sacks().size());
+    EXPECT_EQ(kWrap + 2000, merged_sacks.sacks().begin()[0].start_);
+    EXPECT_EQ(2000 + 1000, merged_sacks.num_bytes());
+
+    merged_sacks.RemoveAcked(kWrap + 7000);
+    EXPECT_TRUE(merged_sacks.empty());
+    EXPECT_EQ(0, merged_sacks.num_bytes());
+}
+
+TEST(TcpEndpointTest, ReturnsStateWithoutCopies) {
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/basic.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    ASSERT_EQ(1, flow_map->num_flows());
+
+    const TcpEndpoint* a = flow_map->GetFlows().front()->endpoint_a();
+    ASSERT_NE(nullptr, a);
+    ASSERT_FALSE(a->packets().empty());
+
+    // Accessors hand out the stored containers instead of copies
+    EXPECT_EQ(&a->packets(), &a->packets());
+    EXPECT_EQ(&a->timer(), &a->timer());
+    EXPECT_EQ(&a->timer().samples(), &a->timer().samples());
+    const Packet* packet = a->packets().front();
+    EXPECT_EQ(&packet->tcp()->sacks(), &packet->tcp()->sacks());
+
+    // Percentiles of unsorted values leave the input untouched
+    const std::vector<uint32_t> values({5, 1, 4, 2, 3});
+    EXPECT_EQ(3, stats_util::Median(values));
+    EXPECT_EQ(5, stats_util::Percentile(values, 100));
+    EXPECT_EQ(std::vector<uint32_t>({5, 1, 4, 2, 3}), values);
+}
+
+TEST(TcpEndpointTest, TracksPacketsInFlight) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+    constexpr uint32_t kSeq = 5000;
+
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr)];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    TcpFlowMap flow_map;
+    auto add_packet = [&](bool from_server, uint8_t flags, uint32_t seq,
+            uint32_t ack, uint16_t data_len, uint32_t timestamp_ms) {
+        if (from_server) {
+            MakeTcpFrame(frame, server_addr, 80, client_addr, 50000, flags,
+                    seq, ack);
+        } else {
+            MakeTcpFrame(frame, client_addr, 50000, server_addr, 80, flags,
+                    seq, ack);
+        }
+        auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+        ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + data_len);
+        pcap_header.ts.tv_usec = timestamp_ms * 1000;
+        Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+    };
+    add_packet(false, TH_SYN, 1000, 0, 0, 0);
+    add_packet(true, TH_SYN|TH_ACK, kSeq, 1001, 0, 10);
+    add_packet(false, TH_ACK, 1001, kSeq + 1, 0, 20);
+    add_packet(true, TH_ACK, kSeq + 1, 1001, 200, 21);
+    add_packet(true, TH_ACK, kSeq + 201, 1001, 200, 22);
+
+    const TcpEndpoint* server = flow_map.GetFlows().front()->endpoint_b();
+    ASSERT_NE(nullptr, server);
+    EXPECT_EQ(2, server->num_in_flight());
+    EXPECT_EQ(0, server->num_unacked_lost());
+
+    // The retransmission marks the first data packet as lost
+    add_packet(true, TH_ACK, kSeq + 1, 1001, 200, 500);
+    EXPECT_EQ(2, server->num_in_flight());
+    EXPECT_EQ(1, server->num_unacked_lost());
+    EXPECT_EQ(1, server->GetNumLosses());
+
+    add_packet(false, TH_ACK, 1001, kSeq + 201, 0, 520);
+    EXPECT_EQ(1, server->num_in_flight());
+    EXPECT_EQ(0, server->num_unacked_lost());
+    EXPECT_EQ(1, server->GetNumLosses());
+
+    add_packet(false, TH_ACK, 1001, kSeq + 401, 0, 530);
+    EXPECT_EQ(0, server->num_in_flight());
+    EXPECT_EQ(0, server->num_unacked_lost());
+}
+
+TEST(FenwickTreeTest, AddsToSuffixes) {
+    FenwickTree tree;
+    for (int i = 0; i < 5; i++) {
+        tree.Append();
+    }
+    tree.AddFrom(2, 10);
+    tree.AddFrom(0, -3);
+    tree.AddFrom(5, 100);
+
+    // Values appended later are not affected by earlier deltas
+    for (int i = 0; i < 4; i++) {
+        tree.Append();
+    }
+    tree.AddFrom(7, 1);
+    ASSERT_EQ(9, tree.size());
+    const std::vector<int64_t> expected({-3, -3, 7, 7, 7, 0, 0, 1, 1});
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i], tree.Get(i));
+    }
+}
+
+TEST(TcpEndpointTest, CorrectsUnackedBytesForSackLookalikes) {
+    const uint32_t client_addr = inet_addr("10.0.0.1");
+    const uint32_t server_addr = inet_addr("10.0.0.2");
+    constexpr uint32_t kSeq = 5000;
+
+    // ACKs may announce a SACK block in options that were not captured
+    constexpr size_t kOptionsLen = 12;
+    u_char frame[sizeof(ether_header) + sizeof(ip) + sizeof(tcphdr) +
+        kOptionsLen];
+    struct pcap_pkthdr pcap_header = {{0, 0}, sizeof(frame), sizeof(frame)};
+    TcpFlowMap flow_map;
+    auto add_packet = [&](bool from_server, uint8_t flags, uint32_t seq,
+            uint32_t ack, uint16_t data_len, uint32_t timestamp_ms,
+            bool truncated_options) {
+        if (from_server) {
+            MakeTcpFrame(frame, server_addr, 80, client_addr, 50000, flags,
+                    seq, ack);
+        } else {
+            MakeTcpFrame(frame, client_addr, 50000, server_addr, 80, flags,
+                    seq, ack);
+        }
+        const size_t options_len = truncated_options ? kOptionsLen : 0;
+        auto ip_header = reinterpret_cast<struct ip*>(frame + sizeof(ether_header));
+        ip_header->ip_len = htons(sizeof(ip) + sizeof(tcphdr) + options_len +
+                data_len);
+        auto tcp_header = reinterpret_cast<struct tcphdr*>(
+                frame + sizeof(ether_header) + sizeof(ip));
+        tcp_header->th_off = (sizeof(tcphdr) + options_len) / 4;
+        pcap_header.ts.tv_usec = timestamp_ms * 1000;
+        pcap_header.caplen = sizeof(frame) - kOptionsLen;
+        Packet packet(frame, &pcap_header, LinkType<DLT_EN10MB>());
+        EXPECT_TRUE(flow_map.AddPacket(&packet, true));
+    };
+    add_packet(false, TH_SYN, 1000, 0, 0, 0, false);
+    add_packet(true, TH_SYN|TH_ACK, kSeq, 1001, 0, 10, false);
+    add_packet(false, TH_ACK, 1001, kSeq + 1, 0, 20, false);
+    add_packet(true, TH_ACK, kSeq + 1, 1001, 200, 21, false);
+    add_packet(true, TH_ACK, kSeq + 201, 1001, 200, 22, false);
+    add_packet(true, TH_ACK, kSeq + 401, 1001, 200, 23, false);
+    add_packet(false, TH_ACK, 1001, kSeq + 1, 0, 100, true);
+
+    // Retransmitting the second packet ties the first packet to the SACK
+    // lookalike. The counts of the packets transmitted up to now are corrected
+    add_packet(true, TH_ACK, kSeq + 201, 1001, 200, 110, false);
+
+    const TcpEndpoint* server = flow_map.GetFlows().front()->endpoint_b();
+    ASSERT_NE(nullptr, server);
+    const auto& packets = server->packets();
+    ASSERT_EQ(5, packets.size());
+    EXPECT_NE(nullptr, packets[1]->tcp()->ack_packet());
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(packets[i]->tcp()->unacked_bytes() + 200,
+                server->GetUnackedBytes(*packets[i]));
+    }
+    EXPECT_EQ(packets[4]->tcp()->unacked_bytes(),
+            server->GetUnackedBytes(*packets[4]));
+}
+
+TEST(LinearFitAccumulatorTest, MatchesSeparatePasses) {
+    const std::vector<double> x({1e6, 1e6 + 1500, 1e6 + 3000, 1e6 + 4500,
+            1e6 + 6000, 1e6 + 9000});
+    const std::vector<double> y({50e3, 50.9e3, 52.1e3, 53e3, 53.8e3, 56.2e3});
+    stats_util::LinearFitAccumulator samples;
+    for (size_t i = 0; i < x.size(); i++) {
+        samples.Add(x[i], y[i]);
+    }
+    ASSERT_EQ(x.size(), samples.num_samples());
+
+    const stats_util::LinearFitParameters expected_fit =
+        stats_util::LinearFit(x, y);
+    const stats_util::LinearFitParameters fit = samples.Fit();
+    EXPECT_NEAR(expected_fit.c_0, fit.c_0, 1e-6 * std::abs(expected_fit.c_0));
+    EXPECT_NEAR(expected_fit.c_1, fit.c_1, 1e-9);
+    EXPECT_NEAR(expected_fit.sum_sq, fit.sum_sq, 1e-6);
+    EXPECT_NEAR(expected_fit.cov_11, fit.cov_11, 1e-12);
+    EXPECT_NEAR(stats_util::PearsonCorrelation(x, y), samples.Correlation(),
+            1e-12);
+
+    // Without samples there is neither a correlation nor a fit
+    stats_util::LinearFitAccumulator no_samples;
+    EXPECT_EQ(0, no_samples.Correlation());
+    EXPECT_EQ(0, no_samples.Fit().c_1);
+}
+
+TEST(UnackedBytesRttWindowTest, MatchesSamplesAroundPacket) {
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/queuing-only.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+    ASSERT_NE(nullptr, b);
+
+    // Windows without any variance have neither a correlation nor a fit
+    auto expect_same_value = [](double expected, double value) {
+        if (std::isnan(expected)) {
+            EXPECT_TRUE(std::isnan(value));
+        } else {
+            EXPECT_DOUBLE_EQ(expected, value);
+        }
+    };
+
+    // Sliding along the packets yields the same samples as collecting them
+    // around each packet separately
+    for (bool use_older_packets_only : {false, true}) {
+        UnackedBytesRttWindow window(*b, 60, use_older_packets_only);
+        for (const Packet* packet : b->packets()) {
+            stats_util::LinearFitAccumulator expected;
+            b->AddUnackedBytesRttSamplesAroundPacket(
+                    *packet, 60, use_older_packets_only, &expected);
+            const auto& samples = window.MoveTo(*packet);
+            ASSERT_EQ(expected.num_samples(), samples.num_samples());
+            expect_same_value(expected.Correlation(), samples.Correlation());
+            expect_same_value(expected.Fit().c_1, samples.Fit().c_1);
+        }
+
+        // Moving back refills the window
+        const Packet* first_packet = b->packets().front();
+        stats_util::LinearFitAccumulator expected;
+        b->AddUnackedBytesRttSamplesAroundPacket(
+                *first_packet, 60, use_older_packets_only, &expected);
+        EXPECT_EQ(expected.num_samples(),
+                window.MoveTo(*first_packet).num_samples());
+    }
+
+    // The per-packet estimates agree with the tail latency analysis for the
+    // worst packet
+    const Packet* worst_packet = nullptr;
+    for (const Packet* packet : b->packets()) {
+        if (packet->tcp()->data_len() && (worst_packet == nullptr ||
+                    packet->tcp()->ack_delay_us() >
+                    worst_packet->tcp()->ack_delay_us())) {
+            worst_packet = packet;
+        }
+    }
+    ASSERT_NE(nullptr, worst_packet);
+    DelayAnalysis delay_b(*b);
+    const Delays latency_b = delay_b.AnalyzeTailLatency();
+    const std::vector<uint32_t> queueing_delays = delay_b.GetQueueingDelays();
+    ASSERT_EQ(b->packets().size(), queueing_delays.size());
+    EXPECT_EQ(latency_b.queueing_us_,
+            queueing_delays[worst_packet->position()]);
+}
+
+TEST(DelayAnalysisTest, BreaksDownEveryPacket) {
+    // Includes retransmissions that were lost again
+    for (const char* filename :
+            {"tests/rto-and-slow-start.pcap", "tests/tlp-and-rto.pcap"}) {
+        TcpFlowMapFactory flow_map_factory;
+        auto flow_map = flow_map_factory.MakeFromPcap(filename);
+        ASSERT_NE(nullptr, flow_map);
+        const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+        ASSERT_NE(nullptr, b);
+
+        DelayAnalysis delay_b(*b);
+        const Delays latency_b = delay_b.AnalyzeTailLatency();
+        const std::vector<PacketDelays> packet_delays =
+            delay_b.AnalyzePacketDelays();
+        ASSERT_EQ(b->GetNumDataPackets(), packet_delays.size());
+
+        // The worst packet (the first with the largest delay) is broken down
+        // like in the tail latency analysis
+        const PacketDelays* worst_delays = nullptr;
+        for (const PacketDelays& delays : packet_delays) {
+            EXPECT_LT(0, delays.first->tcp()->data_len());
+            EXPECT_LE(delays.second.loss_us_, delays.second.overall_us_);
+            EXPECT_LE(delays.second.loss_trigger_us_,
+                    delays.second.overall_us_);
+            EXPECT_LE(delays.second.queueing_us_, delays.second.overall_us_);
+            if (worst_delays == nullptr || delays.second.overall_us_ >
+                    worst_delays->second.overall_us_) {
+                worst_delays = &delays;
+            }
+        }
+        ASSERT_NE(nullptr, worst_delays);
+        EXPECT_EQ(latency_b.overall_us_, worst_delays->second.overall_us_);
+        EXPECT_EQ(latency_b.propagation_us_,
+                worst_delays->second.propagation_us_);
+        EXPECT_EQ(latency_b.loss_us_, worst_delays->second.loss_us_);
+        EXPECT_EQ(latency_b.loss_trigger_us_,
+                worst_delays->second.loss_trigger_us_);
+        EXPECT_EQ(latency_b.queueing_us_, worst_delays->second.queueing_us_);
+        EXPECT_EQ(latency_b.other_us_, worst_delays->second.other_us_);
+    }
+}
+
+TEST(DelayAnalysisTest, AnalyzesWorstPackets) {
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/tlp-and-rto.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+    ASSERT_NE(nullptr, b);
+
+    // Expect the data packets sorted by decreasing ACK delay (the earlier
+    // packet first for equal delays)
+    std::vector<const Packet*> expected_packets;
+    for (const Packet* packet : b->packets()) {
+        if (packet->tcp()->data_len()) {
+            expected_packets.push_back(packet);
+        }
+    }
+    std::stable_sort(expected_packets.begin(), expected_packets.end(),
+            [](const Packet* first, const Packet* second) {
+        return first->tcp()->ack_delay_us() > second->tcp()->ack_delay_us();
+    });
+    ASSERT_LT(3, expected_packets.size());
+
+    DelayAnalysis delay_b(*b);
+    const Delays latency_b = delay_b.AnalyzeTailLatency();
+    const std::vector<PacketDelays> tail_delays =
+        delay_b.AnalyzeTailLatencies(3, 0);
+    ASSERT_EQ(3, tail_delays.size());
+    for (size_t i = 0; i < tail_delays.size(); i++) {
+        EXPECT_EQ(expected_packets[i], tail_delays[i].first);
+        EXPECT_EQ(expected_packets[i]->tcp()->ack_delay_us(),
+                tail_delays[i].second.overall_us_);
+    }
+
+    // The worst packet is analyzed as before, including goodput metrics
+    const Delays& worst_delays = tail_delays.front().second;
+    EXPECT_EQ(latency_b.overall_us_, worst_delays.overall_us_);
+    EXPECT_EQ(latency_b.loss_us_, worst_delays.loss_us_);
+    EXPECT_EQ(latency_b.loss_trigger_us_, worst_delays.loss_trigger_us_);
+    EXPECT_EQ(latency_b.queueing_us_, worst_delays.queueing_us_);
+    EXPECT_EQ(latency_b.other_us_, worst_delays.other_us_);
+    EXPECT_EQ(latency_b.goodput_before_worst_packet_bps_,
+            worst_delays.goodput_before_worst_packet_bps_);
+    EXPECT_EQ(latency_b.bytes_unacked_, worst_delays.bytes_unacked_);
+
+    // Asking for more packets than there are returns all of them
+    EXPECT_EQ(expected_packets.size(),
+            delay_b.AnalyzeTailLatencies(expected_packets.size() + 5, 0)
+            .size());
+}
+
+TEST(WorstPacketIndexTest, MatchesScanUpToCutoffs) {
+    TcpFlowMapFactory flow_map_factory;
+    auto flow_map = flow_map_factory.MakeFromPcap("tests/basic.pcap");
+    ASSERT_NE(nullptr, flow_map);
+    const TcpEndpoint* b = flow_map->GetFlows().front()->endpoint_b();
+    ASSERT_NE(nullptr, b);
+    const std::vector<Packet*>& packets = b->packets();
+
+    WorstPacketIndex index(packets);
+    ASSERT_EQ(packets.size(), index.size());
+    EXPECT_EQ(nullptr, index.GetWorstPacket(0));
+    EXPECT_EQ(nullptr, index.GetFirstDataPacket(0));
+
+    // The index (used for the worst packet alone) finds the same packets as
+    // scanning for the two worst packets
+    DelayAnalysis delay_b(*b);
+    for (uint32_t max_seq = 1; max_seq < 1024 * 1024; max_seq += 7 * 1024) {
+        const auto indexed_delays = delay_b.AnalyzeTailLatencies(1, max_seq);
+        const auto scanned_delays = delay_b.AnalyzeTailLatencies(2, max_seq);
+        ASSERT_EQ(indexed_delays.empty(), scanned_delays.empty());
+        if (!indexed_delays.empty()) {
+            EXPECT_EQ(scanned_delays.front().first,
+                    indexed_delays.front().first);
+            const Delays& indexed = indexed_delays.front().second;
+            const Delays& scanned = scanned_delays.front().second;
+            EXPECT_EQ(scanned.overall_us_, indexed.overall_us_);
+            EXPECT_EQ(scanned.goodput_before_worst_packet_bps_,
+                    indexed.goodput_before_worst_packet_bps_);
+        }
+    }
+}
@@ -0,0 +1,238 @@
+#include "tgz_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Tar archives consist of 512 byte blocks. Each entry starts with a header
+// block (ustar format) and its data is padded to a full block
+constexpr size_t kBlockLen = 512;
+
+constexpr size_t kNameOffset = 0;
+constexpr size_t kNameLen = 100;
+constexpr size_t kSizeOffset = 124;
+constexpr size_t kSizeLen = 12;
+constexpr size_t kChecksumOffset = 148;
+constexpr size_t kChecksumLen = 8;
+constexpr size_t kTypeOffset = 156;
+constexpr size_t kMagicOffset = 257;
+constexpr size_t kPrefixOffset = 345;
+constexpr size_t kPrefixLen = 155;
+
+// Entry types we care about (all others, e.g. directories, are skipped)
+constexpr char kRegularFile = '0';
+constexpr char kOldRegularFile = '\0';
+constexpr char kGnuLongName = 'L';
+
+// Magic number of gzip data
+constexpr u_char kGzipMagic[] = {0x1f, 0x8b};
+
+// Size of the gzip trailer, which ends with the uncompressed size
+constexpr size_t kGzipTrailerLen = 8;
+
+// Returns the NUL-terminated string in the given header field
+static std::string ReadString(const u_char* field, size_t len) {
+    const char* string = reinterpret_cast<const char*>(field);
+    return std::string(string, strnlen(string, len));
+}
+
+// Returns the value of the given header field, which is octal or (for large
+// values in GNU archives) base-256
+static uint64_t ReadNumber(const u_char* field, size_t len) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7f;
+        for (size_t i = 1; i < len; i++) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < len && field[i] == ' ') {
+        i++;
+    }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+// Returns TRUE if the checksum of the header matches (i.e. the sum of all its
+// bytes with the checksum field counted as spaces)
+static bool HasValidChecksum(const u_char* header) {
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < kBlockLen; i++) {
+        const bool is_checksum_field = i >= kChecksumOffset &&
+            i < kChecksumOffset + kChecksumLen;
+        checksum += is_checksum_field ? ' ' : header[i];
+    }
+    return checksum == ReadNumber(header + kChecksumOffset, kChecksumLen);
+}
+
+std::unique_ptr<TgzArchive> TgzArchive::Open(const char* filename) {
+    gzFile file = gzopen(filename, "rb");
+    if (file == NULL) {
+        std::cerr << "gzopen() failed for " << filename << std::endl;
+        return nullptr;
+    }
+    gzbuffer(file, 1 << 17);
+    return std::unique_ptr<TgzArchive>(new TgzArchive(file));
+}
+
+TgzArchive::TgzArchive(gzFile file)
+        : file_(file) {}
+
+TgzArchive::~TgzArchive() {
+    gzclose(file_);
+}
+
+bool TgzArchive::NextEntry(std::string* name, uint64_t* size) {
+    if (is_corrupt_ || !Skip(entry_remaining_ + entry_padding_)) {
+        return false;
+    }
+    entry_remaining_ = 0;
+    entry_padding_ = 0;
+
+    std::string long_name;
+    u_char header[kBlockLen];
+    while (true) {
+        // The archive ends with blocks of zeros (or just ends)
+        const int header_len = gzread(file_, header, kBlockLen);
+        if (header_len == 0 ||
+                (header_len == kBlockLen &&
+                 std::all_of(header, header + kBlockLen,
+                     [](u_char byte) { return byte == 0; }))) {
+            return false;
+        }
+        if (header_len != kBlockLen || !HasValidChecksum(header)) {
+            std::cerr << "Corrupt tar archive" << std::endl;
+            is_corrupt_ = true;
+            return false;
+        }
+
+        const uint64_t entry_size = ReadNumber(header + kSizeOffset, kSizeLen);
+        const uint64_t padding = (kBlockLen - entry_size % kBlockLen) %
+            kBlockLen;
+        const char type = header[kTypeOffset];
+        if (type == kGnuLongName) {
+            // The data of this entry is the name of the next one
+            std::vector<u_char> buffer(entry_size);
+            if (!Read(buffer.data(), entry_size) || !Skip(padding)) {
+                return false;
+            }
+            long_name = ReadString(buffer.data(), entry_size);
+            continue;
+        }
+        if (type != kRegularFile && type != kOldRegularFile) {
+            if (!Skip(entry_size + padding)) {
+                return false;
+            }
+            long_name.clear();
+            continue;
+        }
+
+        if (!long_name.empty()) {
+            *name = long_name;
+        } else {
+            *name = ReadString(header + kNameOffset, kNameLen);
+            const std::string prefix = ReadString(header + kPrefixOffset,
+                    kPrefixLen);
+            if (memcmp(header + kMagicOffset, "ustar", 5) == 0 &&
+                    !prefix.empty()) {
+                *name = prefix + "/" + *name;
+            }
+        }
+        *size = entry_size;
+        entry_remaining_ = entry_size;
+        entry_padding_ = padding;
+        return true;
+    }
+}
+
+bool TgzArchive::ReadEntry(u_char* data, size_t len) {
+    if (len > entry_remaining_ || !Read(data, len)) {
+        return false;
+    }
+    entry_remaining_ -= len;
+    return true;
+}
+
+std::unique_ptr<MappedPcap> TgzArchive::ReadPcapEntry(uint64_t size) {
+    u_char magic[sizeof(kGzipMagic)];
+    if (size < sizeof(magic) || !ReadEntry(magic, sizeof(magic))) {
+        return nullptr;
+    }
+
+    if (memcmp(magic, kGzipMagic, sizeof(magic)) != 0) {
+        return MappedPcap::Load(size, [this, &magic, size](u_char* data) {
+            memcpy(data, magic, sizeof(magic));
+            return ReadEntry(data + sizeof(magic), size - sizeof(magic));
+        });
+    }
+
+    // Compressed traces are decompressed straight into the capture buffer.
+    // The trailer tells us its size upfront
+    std::vector<u_char> compressed(size);
+    memcpy(compressed.data(), magic, sizeof(magic));
+    if (size < kGzipTrailerLen ||
+            !ReadEntry(compressed.data() + sizeof(magic),
+                size - sizeof(magic))) {
+        return nullptr;
+    }
+    const u_char* trailer = compressed.data() + size - kGzipTrailerLen;
+    const size_t uncompressed_len = trailer[4] | (trailer[5] << 8) |
+        (trailer[6] << 16) | (static_cast<uint32_t>(trailer[7]) << 24);
+    return MappedPcap::Load(uncompressed_len,
+            [&compressed, uncompressed_len](u_char* data) {
+        return Gunzip(compressed.data(), compressed.size(), data,
+                uncompressed_len);
+    });
+}
+
+bool TgzArchive::Read(u_char* data, size_t len) {
+    while (len > 0) {
+        const unsigned chunk_len = std::min<size_t>(len, 1 << 30);
+        if (gzread(file_, data, chunk_len) != static_cast<int>(chunk_len)) {
+            std::cerr << "Truncated tar archive" << std::endl;
+            is_corrupt_ = true;
+            return false;
+        }
+        data += chunk_len;
+        len -= chunk_len;
+    }
+    return true;
+}
+
+bool TgzArchive::Skip(uint64_t len) {
+    // Seeking forward decompresses the skipped bytes without copying them
+    if (len > 0 && gzseek(file_, len, SEEK_CUR) < 0) {
+        std::cerr << "Truncated tar archive" << std::endl;
+        is_corrupt_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool TgzArchive::Gunzip(const u_char* data, size_t len, u_char* uncompressed,
+        size_t uncompressed_len) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Only accept the gzip format
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<u_char*>(data);
+    stream.avail_in = len;
+    stream.next_out = uncompressed;
+    stream.avail_out = uncompressed_len;
+    const int result = inflate(&stream, Z_FINISH);
+    const bool is_complete = (result == Z_STREAM_END &&
+            stream.total_out == uncompressed_len);
+    inflateEnd(&stream);
+    if (!is_complete) {
+        std::cerr << "Corrupt gzip-compressed entry" << std::endl;
+    }
+    return is_complete;
+}
@@ -0,0 +1,66 @@
+#ifndef TGZ_ARCHIVE_H_
+#define TGZ_ARCHIVE_H_
+
+#include <memory>
+#include <pcap.h>
+#include <string>
+#include <zlib.h>
+
+#include "mapped_pcap.h"
+
+// Gzip-compressed tar archive (e.g. as published by M-Lab) that is read
+// sequentially. Entries are only decompressed in memory, nothing is extracted
+// to disk
+class TgzArchive {
+    public:
+        // Opens the given archive. Returns nullptr if it cannot be opened
+        static std::unique_ptr<TgzArchive> Open(const char* filename);
+
+        ~TgzArchive();
+
+        TgzArchive(const TgzArchive&) = delete;
+        TgzArchive& operator=(const TgzArchive&) = delete;
+
+        inline bool is_corrupt() const {
+            return is_corrupt_;
+        }
+
+        // Advances to the next regular file in the archive and returns its
+        // name and size. The rest of the previous entry is skipped. Returns
+        // FALSE at the end of the archive or if it is corrupt (see
+        // is_corrupt())
+        bool NextEntry(std::string* name, uint64_t* size);
+
+        // Reads the next len bytes of the current entry
+        bool ReadEntry(u_char* data, size_t len);
+
+        // Reads the (unread) current entry of the given size as a classic PCAP
+        // file, which may be gzip-compressed itself. Returns nullptr if the
+        // entry cannot be read or is not a PCAP file
+        std::unique_ptr<MappedPcap> ReadPcapEntry(uint64_t size);
+
+    private:
+        explicit TgzArchive(gzFile file);
+
+        // Decompresses the given gzip data into the given buffer, which has to
+        // fit the decompressed data exactly
+        static bool Gunzip(const u_char* data, size_t len, u_char* uncompressed,
+                size_t uncompressed_len);
+
+        // Reads the given number of (decompressed) bytes of the archive
+        bool Read(u_char* data, size_t len);
+
+        // Skips the given number of (decompressed) bytes of the archive
+        bool Skip(uint64_t len);
+
+        gzFile file_;
+
+        // Unread bytes of the current entry and the padding up to the next
+        // block
+        uint64_t entry_remaining_ = 0;
+        uint64_t entry_padding_ = 0;
+
+        bool is_corrupt_ = false;
+};
+
+#endif  /* TGZ_ARCHIVE_H_ */
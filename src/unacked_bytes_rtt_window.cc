@@ -0,0 +1,80 @@
+#include "unacked_bytes_rtt_window.h"
+
+#include <algorithm>
+
+UnackedBytesRttWindow::UnackedBytesRttWindow(const TcpEndpoint& endpoint,
+        uint8_t num_samples, bool use_older_packets_only)
+        : endpoint_(endpoint),
+          max_distance_(
+              use_older_packets_only ? num_samples : (num_samples / 2)),
+          use_older_packets_only_(use_older_packets_only) {
+    for (const Packet* packet : endpoint_.packets()) {
+        if (TcpEndpoint::IsUnackedBytesRttSample(*packet)) {
+            samples_.push_back({
+                    packet->position(),
+                    static_cast<double>(endpoint_.GetUnackedBytes(*packet)),
+                    static_cast<double>(packet->tcp()->ack_delay_us())});
+        }
+    }
+    Clear();
+}
+
+const stats_util::LinearFitAccumulator& UnackedBytesRttWindow::MoveTo(
+        const Packet& packet) {
+    const auto& packets = endpoint_.packets();
+    const uint32_t position = packet.position();
+    if (position >= packets.size() || packets[position] != &packet) {
+        Clear();
+        return window_;
+    }
+    if (position < position_) {
+        Clear();
+    }
+    position_ = position;
+
+    while (num_samples_seen_ < samples_.size() &&
+            samples_[num_samples_seen_].position_ <= position) {
+        num_samples_seen_++;
+    }
+    MoveRange(num_samples_seen_ > max_distance_ ?
+                num_samples_seen_ - max_distance_ : 0,
+            num_samples_seen_, &before_);
+
+    // Without any samples up to the packet there is no window around it
+    size_t after_first = num_samples_seen_;
+    size_t after_end = num_samples_seen_;
+    if (num_samples_seen_ && !use_older_packets_only_) {
+        if (samples_[num_samples_seen_ - 1].position_ == position) {
+            after_first--;
+        }
+        after_end = std::min(samples_.size(), after_first + max_distance_);
+    }
+    MoveRange(after_first, after_end, &after_);
+
+    return window_;
+}
+
+void UnackedBytesRttWindow::MoveRange(size_t first, size_t end,
+        SampleRange* range) {
+    // Samples between the old and the new range were never added, so they
+    // are skipped
+    const size_t remove_end = std::min(first, range->second);
+    for (; range->first < remove_end; range->first++) {
+        const Sample& sample = samples_[range->first];
+        window_.Remove(sample.unacked_bytes_, sample.rtt_us_);
+    }
+    range->first = first;
+    range->second = std::max(first, range->second);
+    for (; range->second < end; range->second++) {
+        const Sample& sample = samples_[range->second];
+        window_.Add(sample.unacked_bytes_, sample.rtt_us_);
+    }
+}
+
+void UnackedBytesRttWindow::Clear() {
+    position_ = 0;
+    num_samples_seen_ = 0;
+    before_ = SampleRange(0, 0);
+    after_ = SampleRange(0, 0);
+    window_ = stats_util::LinearFitAccumulator();
+}
@@ -0,0 +1,64 @@
+#ifndef UNACKED_BYTES_RTT_WINDOW_H_
+#define UNACKED_BYTES_RTT_WINDOW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "packet.h"
+#include "tcp_endpoint.h"
+#include "util.h"
+
+// Sliding window over the <# unacked bytes, RTT> samples of an endpoint that
+// holds the same samples as TcpEndpoint::AddUnackedBytesRttSamplesAroundPacket
+// for the packet it was moved to. Moving the window only adds and removes the
+// samples entering and leaving it, so visiting all packets of the endpoint in
+// transmission order takes O(n) overall
+class UnackedBytesRttWindow {
+    public:
+        UnackedBytesRttWindow(const TcpEndpoint& endpoint,
+                uint8_t num_samples, bool use_older_packets_only);
+
+        // Moves the window around the given packet and returns the samples in
+        // it (none if the packet does not belong to the endpoint). Moving back
+        // to an earlier packet refills the window from scratch
+        const stats_util::LinearFitAccumulator& MoveTo(const Packet& packet);
+
+    private:
+        typedef struct {
+            uint32_t position_;
+            double unacked_bytes_;
+            double rtt_us_;
+        } Sample;
+
+        // Range [first, end) of indices into the list of samples
+        typedef std::pair<size_t, size_t> SampleRange;
+
+        // Adds/removes samples until the range is [first, end). Neither end of
+        // the range may move backwards
+        void MoveRange(size_t first, size_t end, SampleRange* range);
+
+        // Drops all samples from the window
+        void Clear();
+
+        const TcpEndpoint& endpoint_;
+        const uint8_t max_distance_;
+        const bool use_older_packets_only_;
+
+        // Samples in transmission order
+        std::vector<Sample> samples_;
+
+        // Position of the packet the window is around and the number of
+        // samples up to and including that packet
+        uint32_t position_;
+        size_t num_samples_seen_;
+
+        // Samples up to (before_) and from (after_) the packet. A sample of
+        // the packet itself is part of both ranges
+        SampleRange before_;
+        SampleRange after_;
+        stats_util::LinearFitAccumulator window_;
+};
+
+#endif  /* UNACKED_BYTES_RTT_WINDOW_H_ */
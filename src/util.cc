@@ -1,47 +1,56 @@
 #include "util.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include <gsl/gsl_fit.h>
 #include <gsl/gsl_histogram2d.h>
 #include <gsl/gsl_statistics.h>
 #include <gsl/gsl_vector.h>
 
-namespace tcp_util {
+namespace stats_util {
 
-bool After(uint32_t first, uint32_t second) {
-   return ((first > second && first - second < 0x7FFFFFFF) ||
-           (first < second && second - first > 0x7FFFFFFF));
-}
+double LinearFitAccumulator::Correlation() const {
+    if (num_samples_ == 0) {
+        return 0;
+    }
 
-bool Before(uint32_t first, uint32_t second) {
-    return After(second, first);
+    // Sums of the squared deviations from the means (and of their products)
+    const double ss_xx = sum_xx_ - sum_x_ * sum_x_ / num_samples_;
+    const double ss_yy = sum_yy_ - sum_y_ * sum_y_ / num_samples_;
+    const double ss_xy = sum_xy_ - sum_x_ * sum_y_ / num_samples_;
+    return ss_xy / (std::sqrt(ss_xx) * std::sqrt(ss_yy));
 }
 
-bool Between(uint32_t middle, uint32_t first, uint32_t second) {
-    return Before(first, middle) && After(second, middle);
-}
+LinearFitParameters LinearFitAccumulator::Fit() const {
+    if (num_samples_ == 0) {
+        return LinearFitParameters{0, 0, 0, 0, 0, 0};
+    }
 
-bool RangeIncluded(uint32_t first_start, uint32_t first_end,
-        uint32_t second_start, uint32_t second_end) {
-    return ((first_start == second_start ||
-             Between(first_start, second_start, second_end)) &&
-            (first_end == second_end ||
-             Between(first_end, second_start, second_end)));
-}
+    const double n = num_samples_;
+    const double mean_x = shift_x_ + sum_x_ / n;
+    const double mean_y = shift_y_ + sum_y_ / n;
+    const double ss_xx = sum_xx_ - sum_x_ * sum_x_ / n;
+    const double ss_yy = sum_yy_ - sum_y_ * sum_y_ / n;
+    const double ss_xy = sum_xy_ - sum_x_ * sum_y_ / n;
 
-bool Overlaps(uint32_t left_a, uint32_t right_a,
-        uint32_t left_b, uint32_t right_b) {
-    return (!After(left_a, right_b) && !After(left_b, right_a));
+    // Same results as gsl_fit_linear, but derived from the sums
+    LinearFitParameters fit;
+    fit.c_1 = ss_xy / ss_xx;
+    fit.c_0 = mean_y - mean_x * fit.c_1;
+    fit.sum_sq = ss_yy - fit.c_1 * ss_xy;
+    if (fit.sum_sq < 0) {
+        fit.sum_sq = 0;
+    }
+    const double s2 = fit.sum_sq / (n - 2);
+    fit.cov_00 = s2 * (1 / n) * (1 + mean_x * mean_x / (ss_xx / n));
+    fit.cov_01 = s2 * -mean_x / ss_xx;
+    fit.cov_11 = s2 / ss_xx;
+    return fit;
 }
 
-}  // namespace tcp_util
-
-
-namespace stats_util {
-
-double PearsonCorrelation(const std::vector<double> x,
-        const std::vector<double> y) {
+double PearsonCorrelation(const std::vector<double>& x,
+        const std::vector<double>& y) {
     if (x.empty()) {
         return 0;
     }
@@ -58,8 +67,8 @@ double PearsonCorrelation(const std::vector<double> x,
             num_samples);
 }
 
-LinearFitParameters LinearFit(const std::vector<double> x,
-        const std::vector<double> y) {
+LinearFitParameters LinearFit(const std::vector<double>& x,
+        const std::vector<double>& y) {
     if (x.empty()) {
         return LinearFitParameters{0, 0, 0, 0, 0, 0};
     }
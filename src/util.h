@@ -2,6 +2,7 @@
 #define UTIL_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -15,19 +16,67 @@ namespace tcp_util {
 // the highest bit would be flipped. Since sequence numbers are 32-bits
 // we assume wraparound if the difference between two sequence numbers
 // is larger than 2^31
-bool After(uint32_t first, uint32_t second);
+inline bool After(uint32_t first, uint32_t second) {
+   return ((first > second && first - second < 0x7FFFFFFF) ||
+           (first < second && second - first > 0x7FFFFFFF));
+}
 
-bool Before(uint32_t first, uint32_t second);
+inline bool Before(uint32_t first, uint32_t second) {
+    return After(second, first);
+}
 
-bool Between(uint32_t middle, uint32_t first, uint32_t second);
+inline bool Between(uint32_t middle, uint32_t first, uint32_t second) {
+    return Before(first, middle) && After(second, middle);
+}
 
 // Checks if the first range is included in the second range
-bool RangeIncluded(uint32_t first_start, uint32_t first_end,
-        uint32_t second_start, uint32_t second_end);
+inline bool RangeIncluded(uint32_t first_start, uint32_t first_end,
+        uint32_t second_start, uint32_t second_end) {
+    return ((first_start == second_start ||
+             Between(first_start, second_start, second_end)) &&
+            (first_end == second_end ||
+             Between(first_end, second_start, second_end)));
+}
 
 // Checks if the two ranges overlap (at least one common value)
-bool Overlaps(uint32_t left_a, uint32_t right_a,
-        uint32_t left_b, uint32_t right_b);
+inline bool Overlaps(uint32_t left_a, uint32_t right_a,
+        uint32_t left_b, uint32_t right_b) {
+    return (!After(left_a, right_b) && !After(left_b, right_a));
+}
+
+// Returns the 64-bit sequence number closest to the given (unwrapped)
+// reference that has the same lower 32 bits as the given sequence number.
+// Unwrapped sequence numbers grow monotonically, so the overloads below
+// compare them directly
+inline uint64_t Unwrap(uint32_t seq, uint64_t reference) {
+    return reference +
+        static_cast<int32_t>(seq - static_cast<uint32_t>(reference));
+}
+
+inline bool After(uint64_t first, uint64_t second) {
+    return first > second;
+}
+
+inline bool Before(uint64_t first, uint64_t second) {
+    return first < second;
+}
+
+inline bool Between(uint64_t middle, uint64_t first, uint64_t second) {
+    return first < middle && middle < second;
+}
+
+inline bool RangeIncluded(uint64_t first_start, uint64_t first_end,
+        uint64_t second_start, uint64_t second_end) {
+    return ((first_start == second_start ||
+             Between(first_start, second_start, second_end)) &&
+            (first_end == second_end ||
+             Between(first_end, second_start, second_end)));
+}
+
+inline bool Overlaps(uint64_t left_a, uint64_t right_a,
+        uint64_t left_b, uint64_t right_b) {
+    return left_a <= right_b && left_b <= right_a;
+}
 
 }  // namespace tcp_util
 
@@ -45,43 +94,103 @@ typedef struct {
     }
 } LinearFitParameters;
 
+// Accumulates <x, y> samples in a single pass to compute both, their Pearson
+// correlation coefficient and the best linear fit with a constant term.
+// Samples are shifted by the first one to keep the sums numerically stable
+class LinearFitAccumulator {
+    public:
+        inline size_t num_samples() const {
+            return num_samples_;
+        }
+
+        inline void Add(double x, double y) {
+            if (num_samples_ == 0) {
+                shift_x_ = x;
+                shift_y_ = y;
+            }
+            const double dx = x - shift_x_;
+            const double dy = y - shift_y_;
+            num_samples_++;
+            sum_x_ += dx;
+            sum_y_ += dy;
+            sum_xx_ += dx * dx;
+            sum_yy_ += dy * dy;
+            sum_xy_ += dx * dy;
+        }
+
+        // Removes a sample that was added before (e.g. when it leaves a
+        // sliding window). Once no samples are left, all sums are reset so
+        // that rounding errors cannot carry over to later samples
+        inline void Remove(double x, double y) {
+            if (--num_samples_ == 0) {
+                *this = LinearFitAccumulator();
+                return;
+            }
+            const double dx = x - shift_x_;
+            const double dy = y - shift_y_;
+            sum_x_ -= dx;
+            sum_y_ -= dy;
+            sum_xx_ -= dx * dx;
+            sum_yy_ -= dy * dy;
+            sum_xy_ -= dx * dy;
+        }
+
+        // Returns the Pearson correlation coefficient of the samples (zero if
+        // there are none)
+        double Correlation() const;
+
+        // Uses regression to compute the best linear fit with a constant term
+        // for the samples
+        LinearFitParameters Fit() const;
+
+    private:
+        size_t num_samples_ = 0;
+        double shift_x_ = 0;
+        double shift_y_ = 0;
+        double sum_x_ = 0;
+        double sum_y_ = 0;
+        double sum_xx_ = 0;
+        double sum_yy_ = 0;
+        double sum_xy_ = 0;
+};
+
 // Returns the x-th percentile in a list of values
 template<typename Number>
-Number Percentile(const std::vector<Number> values, const uint8_t percentile,
+Number Percentile(const std::vector<Number>& values, const uint8_t percentile,
         const bool input_is_sorted);
 
 // Returns the x-th percentile in a list of values
 template<typename Number>
-inline Number Percentile(const std::vector<Number> values,
+inline Number Percentile(const std::vector<Number>& values,
         const uint8_t percentile) {
     return Percentile(values, percentile, false);    
 }
 
 // Returns the median in a sorted list of values
 template<typename Number>
-inline Number Median(const std::vector<Number> values) {
+inline Number Median(const std::vector<Number>& values) {
     return Percentile(values, 50);
 }
 
 // Returns the median in a list of values
 template<typename Number>
-inline Number Median(const std::vector<Number> values, const bool input_is_sorted) {
+inline Number Median(const std::vector<Number>& values, const bool input_is_sorted) {
     return Percentile(values, 50, input_is_sorted);
 }
 
 // Returns the mean (rounded to the Number type if necessary) of a list of values
 template<typename Number>
-inline Number Mean(const std::vector<Number> values);
+inline Number Mean(const std::vector<Number>& values);
 
 // Return Pearson correlation coefficient for two vectors (assuming that
 // both have the same size)
-double PearsonCorrelation(const std::vector<double> x,
-        const std::vector<double> y);
+double PearsonCorrelation(const std::vector<double>& x,
+        const std::vector<double>& y);
 
 // Uses regression to compute the best linear fit with a constant term for the
 // given set of samples
-LinearFitParameters LinearFit(const std::vector<double> x,
-        const std::vector<double> y);
+LinearFitParameters LinearFit(const std::vector<double>& x,
+        const std::vector<double>& y);
 
 // Computes the estimated function value for a given x using the given
 // linear fit as function
@@ -101,7 +210,7 @@ namespace vector_util {
 // Separates a vector of pair values into two vectors storing the first
 // and second values respectively
 template<typename Number>
-void SplitPairs(const std::vector<std::pair<Number, Number>> pairs,
+void SplitPairs(const std::vector<std::pair<Number, Number>>& pairs,
         std::vector<Number>* firsts,
         std::vector<Number>* seconds);
 
@@ -1,25 +1,27 @@
 namespace stats_util {
 
 template<typename Number>
-Number Percentile(const std::vector<Number> values, const uint8_t percentile,
+Number Percentile(const std::vector<Number>& values, const uint8_t percentile,
         const bool input_is_sorted) {
-    std::vector<Number> copy = values;
-    if (copy.empty()) {
+    if (values.empty()) {
         return 0;
     }
-    if (!input_is_sorted) {
-        std::sort(copy.begin(), copy.end());
-    }
-    
-    uint32_t fetch_position = copy.size() * percentile / 100;
-    if (fetch_position == copy.size()) {
+    uint32_t fetch_position = values.size() * percentile / 100;
+    if (fetch_position == values.size()) {
         fetch_position--;
     }
+    if (input_is_sorted) {
+        return values[fetch_position];
+    }
+
+    // Only the unsorted values need to be copied (to select the percentile)
+    std::vector<Number> copy = values;
+    std::nth_element(copy.begin(), copy.begin() + fetch_position, copy.end());
     return copy[fetch_position];
 }
 
 template<typename Number>
-inline Number Mean(const std::vector<Number> values) {
+inline Number Mean(const std::vector<Number>& values) {
     if (values.empty()) {
         return 0;
     }
@@ -35,10 +37,10 @@ inline Number Mean(const std::vector<Number> values) {
 namespace vector_util {
 
 template<typename Number>
-void SplitPairs(const std::vector<std::pair<Number, Number>> pairs,
+void SplitPairs(const std::vector<std::pair<Number, Number>>& pairs,
         std::vector<Number>* firsts,
         std::vector<Number>* seconds) {
-    for (auto pair : pairs) {
+    for (const auto& pair : pairs) {
         firsts->push_back(pair.first);
         seconds->push_back(pair.second);
     }
@@ -0,0 +1,49 @@
+#include "worst_packet_index.h"
+
+#include <algorithm>
+
+#include "tcp_packet.h"
+
+WorstPacketIndex::WorstPacketIndex(const std::vector<Packet*>& packets) {
+    max_seqs_.reserve(packets.size());
+    worst_packets_.reserve(packets.size());
+
+    uint64_t max_seq = 0;
+    const Packet* worst_packet = nullptr;
+    for (const Packet* packet : packets) {
+        const auto* tcp = packet->tcp();
+        max_seq = std::max(max_seq, tcp->unwrapped_seq());
+        if (tcp->data_len()) {
+            if (!first_data_packet_) {
+                first_data_packet_ = packet;
+            }
+            if (!worst_packet ||
+                    tcp->ack_delay_us() > worst_packet->tcp()->ack_delay_us()) {
+                worst_packet = packet;
+            }
+        }
+        max_seqs_.push_back(max_seq);
+        worst_packets_.push_back(worst_packet);
+    }
+}
+
+size_t WorstPacketIndex::GetPrefixLength(uint64_t max_seq) const {
+    return std::upper_bound(max_seqs_.begin(), max_seqs_.end(), max_seq) -
+        max_seqs_.begin();
+}
+
+const Packet* WorstPacketIndex::GetWorstPacket(size_t prefix_length) const {
+    if (!prefix_length) {
+        return nullptr;
+    }
+    return worst_packets_[std::min(prefix_length, size()) - 1];
+}
+
+const Packet* WorstPacketIndex::GetFirstDataPacket(
+        size_t prefix_length) const {
+    if (first_data_packet_ == nullptr ||
+            first_data_packet_->position() >= prefix_length) {
+        return nullptr;
+    }
+    return first_data_packet_;
+}
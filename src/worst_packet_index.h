@@ -0,0 +1,46 @@
+#ifndef WORST_PACKET_INDEX_H_
+#define WORST_PACKET_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "packet.h"
+
+// Index of the data packets with the worst ACK delays among the first packets
+// of an endpoint (in transmission order), s.t. the worst packet up to any
+// sequence number cutoff can be found without scanning the packets again.
+// Prefixes end before the first packet with a sequence number above the
+// cutoff, so they are found by searching the running maximum of the
+// (unwrapped) sequence numbers
+class WorstPacketIndex {
+    public:
+        explicit WorstPacketIndex(const std::vector<Packet*>& packets);
+
+        inline size_t size() const {
+            return max_seqs_.size();
+        }
+
+        // Returns the number of packets before the first one with a sequence
+        // number above the given (unwrapped) one
+        size_t GetPrefixLength(uint64_t max_seq) const;
+
+        // Returns the data packet with the worst ACK delay (the earliest one
+        // if there are several) among the first given number of packets
+        // (nullptr if there is none)
+        const Packet* GetWorstPacket(size_t prefix_length) const;
+
+        // Returns the first data packet among the first given number of
+        // packets (nullptr if there is none)
+        const Packet* GetFirstDataPacket(size_t prefix_length) const;
+
+    private:
+        // Maximum sequence number and worst data packet up to (and including)
+        // each packet
+        std::vector<uint64_t> max_seqs_;
+        std::vector<const Packet*> worst_packets_;
+
+        const Packet* first_data_packet_ = nullptr;
+};
+
+#endif  /* WORST_PACKET_INDEX_H_ */